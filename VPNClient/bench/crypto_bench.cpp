@@ -0,0 +1,307 @@
+// Crypto microbenchmarks for the tunnel encryption paths.
+//
+// Sweeps payload sizes (64 B - 64 KB), cipher modes, thread counts and the
+// in-place / batch AEAD APIs. Every op is one encrypt plus one decrypt of a packet.
+// Every decryption is checked; a case whose packets do not come back intact is reported
+// on stderr instead of producing numbers, and the exit status is 1.
+// Results go to stdout as JSON so runs can be diffed between releases:
+//
+//     vpn_crypto_bench [--duration-ms N] [--max-threads N] > bench.json
+#include "AeadCipher.h"
+#include "Encryption.h"
+#include "EncryptionSession.h"
+#include <openssl/crypto.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#ifndef VPN_PROJECT
+#define VPN_PROJECT "unknown"
+#endif
+
+namespace {
+
+// Heap allocations made by C++ code and by OpenSSL while a case is running.
+std::atomic<unsigned long long> g_allocations(0);
+
+void* countingMalloc(size_t size, const char*, int) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size);
+}
+
+void* countingRealloc(void* address, size_t size, const char*, int) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::realloc(address, size);
+}
+
+void plainFree(void* address, const char*, int) {
+    std::free(address);
+}
+
+unsigned long long cycles() {
+#if defined(BENCH_HAVE_TSC)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+}
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* address = std::malloc(size ? size : 1)) return address;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* address) noexcept {
+    std::free(address);
+}
+
+void operator delete(void* address, size_t) noexcept {
+    std::free(address);
+}
+
+namespace {
+
+const std::string PASSPHRASE = "0123456789abcdef0123456789abcdef";
+const uint8_t AEAD_KEY[AeadCipher::KEY_SIZE] = {0x42};
+const uint8_t AEAD_SALT[AeadCipher::SALT_SIZE] = {0x24};
+const size_t BATCH_SIZE = 32;
+const uint8_t PATTERN = 0xA5;    // Every plaintext byte.
+
+bool intactPayload(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (data[i] != PATTERN) return false;
+    }
+    return true;
+}
+
+// Per-thread state for one mode; run() processes some packets and returns how many,
+// or 0 if a decryption failed. intact() compares the last decrypted output with the
+// plaintext; it is checked after the warm-up run, outside the timed loop.
+class Worker {
+public:
+    virtual ~Worker() {}
+    virtual size_t run() = 0;
+    virtual bool intact() const = 0;
+};
+
+class StaticWorker : public Worker {
+public:
+    explicit StaticWorker(size_t size) : plain_(size, PATTERN) {}
+    size_t run() override {
+        decrypted_ = Encryption::decrypt(Encryption::encrypt(plain_, PASSPHRASE), PASSPHRASE);
+        return decrypted_.size() == plain_.size() ? 1 : 0;
+    }
+    bool intact() const override { return decrypted_ == plain_; }
+private:
+    std::vector<uint8_t> plain_;
+    std::vector<uint8_t> decrypted_;
+};
+
+class SessionWorker : public Worker {
+public:
+    explicit SessionWorker(size_t size) : session_(PASSPHRASE), plain_(size, PATTERN) {}
+    size_t run() override {
+        decrypted_ = session_.decrypt(session_.encrypt(plain_));
+        return decrypted_.size() == plain_.size() ? 1 : 0;
+    }
+    bool intact() const override { return decrypted_ == plain_; }
+private:
+    EncryptionSession session_;
+    std::vector<uint8_t> plain_;
+    std::vector<uint8_t> decrypted_;
+};
+
+class InPlaceWorker : public Worker {
+public:
+    InPlaceWorker(AeadCipher::Algorithm algorithm, size_t size)
+        : cipher_(algorithm, AEAD_KEY, AEAD_SALT, AEAD_SALT), size_(size), buffer_(size + AeadCipher::OVERHEAD, PATTERN) {}
+    size_t run() override {
+        size_t sealed = cipher_.encrypt(buffer_.data(), buffer_.size(), size_);
+        size_t payloadLength = 0;
+        bool ok = sealed > 0 && cipher_.decrypt(buffer_.data(), sealed, payloadLength);
+        return ok && payloadLength == size_ ? 1 : 0;
+    }
+    bool intact() const override { return intactPayload(buffer_.data() + AeadCipher::HEADROOM, size_); }
+private:
+    AeadCipher cipher_;
+    size_t size_;
+    std::vector<uint8_t> buffer_;
+};
+
+class BatchWorker : public Worker {
+public:
+    BatchWorker(AeadCipher::Algorithm algorithm, size_t size)
+        : cipher_(algorithm, AEAD_KEY, AEAD_SALT, AEAD_SALT), size_(size)
+        , buffers_(BATCH_SIZE, std::vector<uint8_t>(size + AeadCipher::OVERHEAD, PATTERN))
+        , packets_(BATCH_SIZE) {}
+    size_t run() override {
+        for (size_t i = 0; i < BATCH_SIZE; ++i) {
+            packets_[i].buffer = buffers_[i].data();
+            packets_[i].capacity = buffers_[i].size();
+            packets_[i].length = size_;
+        }
+        if (cipher_.encryptBatch(packets_.data(), packets_.size()) != BATCH_SIZE) return 0;
+        return cipher_.decryptBatch(packets_.data(), packets_.size()) == BATCH_SIZE ? BATCH_SIZE : 0;
+    }
+    bool intact() const override {
+        for (size_t i = 0; i < BATCH_SIZE; ++i) {
+            if (packets_[i].length != size_ || !intactPayload(buffers_[i].data() + AeadCipher::HEADROOM, size_)) return false;
+        }
+        return true;
+    }
+private:
+    AeadCipher cipher_;
+    size_t size_;
+    std::vector<std::vector<uint8_t>> buffers_;
+    std::vector<AeadPacket> packets_;
+};
+
+struct Mode {
+    const char* name;
+    const char* api;
+    std::function<Worker*(size_t)> create;
+};
+
+struct Result {
+    unsigned long long packets = 0;
+    unsigned long long cycles = 0;
+    bool failed = false;    // A packet did not decrypt back to the plaintext.
+};
+
+void runThread(const Mode& mode, size_t size, std::chrono::milliseconds duration,
+               std::atomic<unsigned>& ready, std::atomic<bool>& start, Result& result) {
+    std::unique_ptr<Worker> worker(mode.create(size));
+    // Warm up caches and lazy initialisation, and check the round trip once.
+    result.failed = worker->run() == 0 || !worker->intact();
+    ready.fetch_add(1, std::memory_order_release);
+    while (!start.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    if (result.failed) return;
+
+    auto deadline = std::chrono::steady_clock::now() + duration;
+    unsigned long long begin = cycles();
+    do {
+        for (int i = 0; i < 8; ++i) {
+            size_t packets = worker->run();
+            if (packets == 0) {
+                result.failed = true;
+                return;
+            }
+            result.packets += packets;
+        }
+    } while (std::chrono::steady_clock::now() < deadline);
+    result.cycles = cycles() - begin;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    // Must run before OpenSSL allocates anything.
+    CRYPTO_set_mem_functions(countingMalloc, countingRealloc, plainFree);
+
+    std::chrono::milliseconds duration(50);
+    unsigned maxThreads = std::thread::hardware_concurrency();
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--duration-ms") == 0) duration = std::chrono::milliseconds(std::atoi(argv[i + 1]));
+        else if (std::strcmp(argv[i], "--max-threads") == 0) maxThreads = static_cast<unsigned>(std::atoi(argv[i + 1]));
+    }
+    if (maxThreads == 0) maxThreads = 1;
+
+    const Mode modes[] = {
+        {"aes-256-cbc", "static", [](size_t size) { return new StaticWorker(size); }},
+        {"aes-256-cbc", "session", [](size_t size) { return new SessionWorker(size); }},
+        {"aes-256-gcm", "in-place", [](size_t size) { return new InPlaceWorker(AeadCipher::AES_256_GCM, size); }},
+        {"chacha20-poly1305", "in-place", [](size_t size) { return new InPlaceWorker(AeadCipher::CHACHA20_POLY1305, size); }},
+        {"aes-256-gcm", "batch", [](size_t size) { return new BatchWorker(AeadCipher::AES_256_GCM, size); }},
+        {"chacha20-poly1305", "batch", [](size_t size) { return new BatchWorker(AeadCipher::CHACHA20_POLY1305, size); }},
+    };
+    const size_t sizes[] = {64, 128, 256, 512, 1024, 1400, 2048, 4096, 8192, 16384, 32768, 65536};
+
+    std::vector<unsigned> threadCounts;
+    for (unsigned threads = 1; threads < maxThreads; threads *= 2) threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    std::printf("{\n  \"benchmark\": \"vpn_crypto_bench\",\n  \"project\": \"%s\",\n", VPN_PROJECT);
+    std::printf("  \"duration_ms\": %lld,\n  \"tsc\": %s,\n  \"results\": [", static_cast<long long>(duration.count()),
+#if defined(BENCH_HAVE_TSC)
+                "true"
+#else
+                "false"
+#endif
+    );
+
+    bool first = true;
+    bool failed = false;
+    for (const Mode& mode : modes) {
+        for (size_t size : sizes) {
+            for (unsigned threads : threadCounts) {
+                std::vector<Result> results(threads);
+                std::vector<std::thread> pool;
+                std::atomic<unsigned> ready(0);
+                std::atomic<bool> start(false);
+                for (unsigned t = 0; t < threads; ++t) {
+                    pool.emplace_back(runThread, std::cref(mode), size, duration,
+                                      std::ref(ready), std::ref(start), std::ref(results[t]));
+                }
+
+                // Threads set up their workers first; only the timed loops are counted.
+                while (ready.load(std::memory_order_acquire) < threads) {
+                    std::this_thread::yield();
+                }
+                unsigned long long allocationsBefore = g_allocations.load();
+                auto begin = std::chrono::steady_clock::now();
+                start.store(true, std::memory_order_release);
+                for (std::thread& thread : pool) thread.join();
+                double wallNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+                unsigned long long allocations = g_allocations.load() - allocationsBefore;
+
+                Result total;
+                for (const Result& result : results) {
+                    total.packets += result.packets;
+                    total.cycles += result.cycles;
+                    total.failed = total.failed || result.failed;
+                }
+                if (total.failed || total.packets == 0) {
+                    std::fprintf(stderr, "vpn_crypto_bench: %s %s, %zu bytes, %u threads: decryption failed, case skipped\n",
+                                 mode.name, mode.api, size, threads);
+                    failed = true;
+                    continue;
+                }
+                double bytes = static_cast<double>(total.packets) * size;
+
+                std::printf("%s\n    {\"mode\": \"%s\", \"api\": \"%s\", \"size\": %zu, \"threads\": %u, "
+                            "\"packets\": %llu, \"ns_per_packet\": %.1f, \"cycles_per_byte\": %.3f, "
+                            "\"mb_per_s\": %.1f, \"allocations_per_op\": %.2f}",
+                            first ? "" : ",", mode.name, mode.api, size, threads, total.packets,
+                            wallNs * threads / total.packets,
+                            total.cycles / bytes,
+                            bytes / wallNs * 1e3,
+                            static_cast<double>(allocations) / total.packets);
+                std::fflush(stdout);
+                first = false;
+            }
+        }
+    }
+    std::printf("\n  ]\n}\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+// Packet data plane throughput without a TUN device or CAP_NET_ADMIN.
+//
+// Synthetic IPv4 packets go through the same steps as in VPNClient::runPacketTunnel and
+// VPNServer's data plane, with MemoryPacketSource standing in for the TUN queues and a
+// socket pair per queue for the connection (no TLS):
+//   producer -> MemoryPacketSource -> readBatch -> DATA frames via FrameCoalescer
+//            -> socket pair -> FrameParser -> PacketQueues (flow hash) -> MemoryPacketSource
+// The coalescer is flushed once per batch, as the client does, so larger batches mean
+// fewer, larger writes. Two sweeps:
+//   - batch sizes 1 to 64 on one queue,
+//   - 1, 2, 4, ... queues up to the core count (one worker each, batches of 64); each
+//     queue carries its own flows, as the kernel steers them with IFF_MULTI_QUEUE.
+// Reported per run: packets and megabytes per second and the writes the senders issued.
+//
+//     vpn_tun_bench [--packets N] [--size BYTES] > tun_bench.json
+#include "FrameCoalescer.h"
+#include "Framing.h"
+#include "PacketSource.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#ifndef VPN_PROJECT
+#define VPN_PROJECT "unknown"
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const size_t BATCH_SIZES[] = {1, 8, 32, 64};
+const size_t BATCH_MODES = sizeof(BATCH_SIZES) / sizeof(BATCH_SIZES[0]);
+const size_t MAX_QUEUES = 256;    // TunDevice::MAX_QUEUES, the kernel's limit.
+
+struct Result {
+    size_t batch = 0;
+    size_t queues = 0;
+    double seconds = 0;
+    uint64_t delivered = 0;
+    uint64_t writes = 0;
+};
+
+// A UDP packet from 10.8.0.2:`port` to 10.8.0.1:53, padded to `size` bytes.
+std::vector<uint8_t> makePacket(size_t size, uint16_t port) {
+    std::vector<uint8_t> packet(size < 28 ? 28 : size, 0x5a);
+    const uint8_t header[20] = {0x45, 0, 0, 0, 0, 0, 0x40, 0, 64, 17, 0, 0, 10, 8, 0, 2, 10, 8, 0, 1};
+    std::memcpy(packet.data(), header, sizeof(header));
+    packet[2] = static_cast<uint8_t>(packet.size() >> 8);
+    packet[3] = static_cast<uint8_t>(packet.size());
+    packet[20] = static_cast<uint8_t>(port >> 8);
+    packet[21] = static_cast<uint8_t>(port);
+    packet[22] = 0;
+    packet[23] = 53;
+    return packet;
+}
+
+// Server end of one connection: parses frames until EOF and writes every IP packet
+// into the queue of its flow.
+void receive(int fd, PacketQueues& sink) {
+    FrameParser parser;
+    FrameView frame;
+    for (;;) {
+        FrameParser::Result result;
+        while ((result = parser.next(frame)) == FrameParser::FRAME) {
+            if (frame.type == FRAME_DATA) {
+                sink.write(frame.payload, frame.length);
+            }
+        }
+        if (result == FrameParser::INVALID) return;
+        ssize_t received = read(fd, parser.writeBuffer(), parser.writable());
+        if (received <= 0) return;
+        parser.commit(static_cast<size_t>(received));
+    }
+}
+
+// Client worker of one queue: batches from `source` into DATA frames on `fd`.
+void send(size_t queue, size_t queues, MemoryPacketSource& source, int fd, size_t batchSize,
+          uint64_t packets, uint64_t& writes) {
+    if (queues > 1) {
+        PacketQueues::pinToCore(queue);
+    }
+    FrameCoalescer coalescer([fd](const uint8_t* data, size_t length) {
+        while (length > 0) {
+            ssize_t written = write(fd, data, length);
+            if (written <= 0) return false;
+            data += written;
+            length -= static_cast<size_t>(written);
+        }
+        return true;
+    });
+    PacketBatch batch(batchSize);
+    uint64_t sent = 0;
+    while (sent < packets) {
+        batch.clear();
+        if (source.readBatch(batch, 1000) <= 0) break;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            coalescer.send(FRAME_DATA, batch.data(i), batch.length(i));
+        }
+        coalescer.flush();
+        sent += batch.size();
+    }
+    writes = coalescer.writes();
+    shutdown(fd, SHUT_WR);    // EOF for the receiver.
+}
+
+Result run(size_t batchSize, size_t queues, uint64_t packets, size_t packetSize) {
+    std::vector<std::shared_ptr<MemoryPacketSource>> client;
+    std::vector<std::shared_ptr<PacketSource>> server;
+    std::vector<int> fds(queues * 2, -1);
+    for (size_t q = 0; q < queues; ++q) {
+        client.push_back(std::make_shared<MemoryPacketSource>(false));
+        server.push_back(std::make_shared<MemoryPacketSource>(false));
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[q * 2]) < 0) throw std::runtime_error("socketpair failed");
+    }
+    PacketQueues serverQueues(server);
+    uint64_t perQueue = packets / queues;
+    std::vector<uint64_t> writes(queues, 0);
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t q = 0; q < queues; ++q) {
+        MemoryPacketSource& source = *client[q];
+        threads.emplace_back([&source, q, perQueue, packetSize]() {
+            std::vector<uint8_t> packet = makePacket(packetSize, static_cast<uint16_t>(10000 + q));
+            for (uint64_t i = 0; i < perQueue; ++i) {
+                if (!source.inject(packet.data(), packet.size())) return;
+            }
+        });
+        threads.emplace_back(send, q, queues, std::ref(source), fds[q * 2], batchSize, perQueue, std::ref(writes[q]));
+        threads.emplace_back(receive, fds[q * 2 + 1], std::ref(serverQueues));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    Result result;
+    result.batch = batchSize;
+    result.queues = queues;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (size_t q = 0; q < queues; ++q) {
+        result.delivered += static_cast<MemoryPacketSource&>(*server[q]).writtenPackets();
+        result.writes += writes[q];
+    }
+    for (int fd : fds) close(fd);
+    return result;
+}
+
+void printResult(const char* key, size_t value, const Result& result, size_t packetSize, bool last) {
+    double seconds = result.seconds > 0 ? result.seconds : 1e-9;
+    std::printf("    \"%s%zu\": {\"batch\": %zu, \"queues\": %zu, \"packets_per_s\": %.0f, \"mb_per_s\": %.1f, "
+                "\"writes\": %llu, \"delivered\": %llu}%s\n",
+                key, value, result.batch, result.queues, result.delivered / seconds,
+                result.delivered * packetSize / seconds / (1024.0 * 1024.0),
+                static_cast<unsigned long long>(result.writes),
+                static_cast<unsigned long long>(result.delivered), last ? "" : ",");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t packets = 1000000;
+    size_t size = 1400;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--packets") == 0) packets = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--size") == 0) size = std::strtoul(argv[i + 1], nullptr, 10);
+    }
+    if (size > PacketBatch::DEFAULT_SLOT_SIZE) size = PacketBatch::DEFAULT_SLOT_SIZE;
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores == 0) cores = 1;
+
+    try {
+        std::vector<Result> batches;
+        for (size_t mode = 0; mode < BATCH_MODES; ++mode) {
+            batches.push_back(run(BATCH_SIZES[mode], 1, packets, size));
+        }
+        std::vector<Result> queues;
+        for (size_t count = 1;; count *= 2) {
+            queues.push_back(run(PacketBatch::DEFAULT_CAPACITY, count, packets, size));
+            if (count >= cores || count * 2 > MAX_QUEUES) break;
+        }
+
+        std::printf("{\n  \"benchmark\": \"vpn_tun_bench\",\n  \"project\": \"%s\",\n", VPN_PROJECT);
+        std::printf("  \"packets\": %llu,\n  \"packet_size\": %zu,\n  \"cores\": %u,\n  \"batches\": {\n",
+                    static_cast<unsigned long long>(packets), size, cores);
+        bool complete = true;
+        for (size_t i = 0; i < batches.size(); ++i) {
+            printResult("batch_", batches[i].batch, batches[i], size, i + 1 == batches.size());
+            complete = complete && batches[i].delivered == packets;
+        }
+        std::printf("  },\n  \"queues\": {\n");
+        for (size_t i = 0; i < queues.size(); ++i) {
+            printResult("queues_", queues[i].queues, queues[i], size, i + 1 == queues.size());
+            complete = complete && queues[i].delivered == packets / queues[i].queues * queues[i].queues;
+        }
+        std::printf("  }\n}\n");
+        return complete ? 0 : 1;
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "vpn_tun_bench: %s\n", e.what());
+        return 1;
+    }
+}
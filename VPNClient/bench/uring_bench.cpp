@@ -0,0 +1,255 @@
+// Loopback receive throughput and syscall count: epoll + recv() against io_uring.
+//
+// A sender thread pushes the same number of bytes into each of --connections
+// loopback TCP connections. The receiving side drains them either the way the epoll
+// backend does (epoll_wait(), then recv() on every ready socket until EAGAIN) or the
+// way the io_uring backend does (one multishot receive per connection into provided
+// buffers, completions reaped by io_uring_enter()). Reported per mode: throughput and
+// the syscalls the receiver made.
+//
+//     vpn_uring_bench [--connections N] [--megabytes M] > uring_bench.json
+//
+// The io_uring mode is skipped (and reported as unavailable) without VPN_IO_URING or
+// on kernels that lack what IoUring needs.
+#include "IoUring.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#ifndef VPN_PROJECT
+#define VPN_PROJECT "unknown"
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const size_t CHUNK_SIZE = 64 * 1024;
+const size_t RECEIVE_SIZE = IoUring::BUFFER_SIZE;    // Same reads for both modes.
+
+struct Result {
+    bool available = false;
+    double seconds = 0;
+    uint64_t bytes = 0;
+    uint64_t syscalls = 0;
+    uint64_t waits = 0;     // epoll_wait() or io_uring_enter().
+    uint64_t reads = 0;     // recv() calls or receive completions.
+};
+
+// Connected pairs: first the receiving end, second the sending end.
+std::vector<std::pair<int, int>> connectPairs(unsigned count) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(listener, SOMAXCONN) < 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) < 0) {
+        throw std::runtime_error(std::string("cannot listen: ") + std::strerror(errno));
+    }
+
+    std::vector<std::pair<int, int>> pairs;
+    for (unsigned i = 0; i < count; ++i) {
+        int sender = socket(AF_INET, SOCK_STREAM, 0);
+        if (sender < 0 || connect(sender, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            throw std::runtime_error(std::string("cannot connect: ") + std::strerror(errno));
+        }
+        int receiver = accept(listener, nullptr, nullptr);
+        if (receiver < 0) throw std::runtime_error(std::string("cannot accept: ") + std::strerror(errno));
+        pairs.push_back(std::make_pair(receiver, sender));
+    }
+    close(listener);
+    return pairs;
+}
+
+void closePairs(const std::vector<std::pair<int, int>>& pairs) {
+    for (const auto& pair : pairs) {
+        close(pair.first);
+        close(pair.second);
+    }
+}
+
+// Round-robins chunks over the connections, then closes them so the receiver sees EOF.
+void sendAll(const std::vector<std::pair<int, int>>& pairs, uint64_t perConnection) {
+    std::vector<uint8_t> chunk(CHUNK_SIZE, 0x5a);
+    std::vector<uint64_t> left(pairs.size(), perConnection);
+    size_t open = pairs.size();
+    while (open > 0) {
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            if (left[i] == 0) continue;
+            size_t size = static_cast<size_t>(std::min<uint64_t>(left[i], CHUNK_SIZE));
+            ssize_t sent = send(pairs[i].second, chunk.data(), size, MSG_NOSIGNAL);
+            if (sent <= 0) {
+                left[i] = 0;
+            }
+            else {
+                left[i] -= static_cast<uint64_t>(sent);
+            }
+            if (left[i] == 0) {
+                shutdown(pairs[i].second, SHUT_WR);
+                --open;
+            }
+        }
+    }
+}
+
+Result receiveEpoll(const std::vector<std::pair<int, int>>& pairs) {
+    Result result;
+    result.available = true;
+    int epoll = epoll_create1(0);
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        fcntl(pairs[i].first, F_SETFL, fcntl(pairs[i].first, F_GETFL) | O_NONBLOCK);
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = i;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, pairs[i].first, &event);
+    }
+
+    std::vector<uint8_t> buffer(RECEIVE_SIZE);
+    std::vector<epoll_event> events(pairs.size());
+    size_t open = pairs.size();
+    while (open > 0) {
+        int ready = epoll_wait(epoll, events.data(), static_cast<int>(events.size()), 1000);
+        ++result.waits;
+        for (int e = 0; e < ready; ++e) {
+            int fd = pairs[events[e].data.u64].first;
+            for (;;) {
+                ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+                ++result.reads;
+                if (received > 0) {
+                    result.bytes += static_cast<uint64_t>(received);
+                    continue;
+                }
+                if (received == 0 || errno != EAGAIN) {
+                    epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+                    --open;
+                }
+                break;
+            }
+        }
+    }
+    close(epoll);
+    result.syscalls = result.waits + result.reads;
+    return result;
+}
+
+Result receiveRing(const std::vector<std::pair<int, int>>& pairs) {
+    Result result;
+    if (!IoUring::available()) return result;
+    result.available = true;
+
+    IoUring ring;
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        ring.receiveMultishot(pairs[i].first, i + 1);
+    }
+
+    std::vector<IoUring::Completion> completions;
+    size_t open = pairs.size();
+    while (open > 0) {
+        completions.clear();
+        if (!ring.wait(1000, completions)) throw std::runtime_error("io_uring_enter failed");
+        for (const IoUring::Completion& completion : completions) {
+            if (completion.userData == IoUring::IGNORED) continue;
+            ++result.reads;
+            if (completion.result > 0) {
+                result.bytes += static_cast<uint64_t>(completion.result);
+                ring.recycleBuffer(completion.buffer());
+            }
+            else if (completion.result == 0) {
+                --open;    // EOF.
+                continue;
+            }
+            else if (completion.result != -ENOBUFS) {
+                throw std::runtime_error(std::string("receive failed: ") + std::strerror(-completion.result));
+            }
+            if (!completion.more()) {
+                ring.receiveMultishot(pairs[completion.userData - 1].first, completion.userData);
+            }
+        }
+    }
+    result.waits = ring.stats().enters;
+    result.syscalls = result.waits;
+    return result;
+}
+
+Result run(bool useRing, unsigned connections, uint64_t perConnection) {
+    std::vector<std::pair<int, int>> pairs = connectPairs(connections);
+    Clock::time_point start = Clock::now();
+    std::thread sender(sendAll, std::cref(pairs), perConnection);
+    Result result;
+    try {
+        result = useRing ? receiveRing(pairs) : receiveEpoll(pairs);
+    }
+    catch (...) {
+        for (const auto& pair : pairs) shutdown(pair.first, SHUT_RDWR);    // Unblock the sender.
+        sender.join();
+        closePairs(pairs);
+        throw;
+    }
+    if (!result.available) {
+        for (const auto& pair : pairs) shutdown(pair.first, SHUT_RDWR);
+    }
+    sender.join();
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    closePairs(pairs);
+    return result;
+}
+
+void printResult(const char* name, const Result& result, bool last) {
+    if (!result.available) {
+        std::printf("    \"%s\": {\"available\": false}%s\n", name, last ? "" : ",");
+        return;
+    }
+    double megabytes = static_cast<double>(result.bytes) / (1024.0 * 1024.0);
+    std::printf("    \"%s\": {\"available\": true, \"mb_per_s\": %.1f, \"syscalls\": %llu, \"waits\": %llu, "
+                "\"reads\": %llu, \"bytes_per_syscall\": %.0f}%s\n",
+                name, result.seconds > 0 ? megabytes / result.seconds : 0.0,
+                static_cast<unsigned long long>(result.syscalls), static_cast<unsigned long long>(result.waits),
+                static_cast<unsigned long long>(result.reads),
+                result.syscalls ? static_cast<double>(result.bytes) / result.syscalls : 0.0, last ? "" : ",");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    unsigned connections = 64;
+    unsigned megabytes = 256;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--connections") == 0) connections = static_cast<unsigned>(std::strtoul(argv[i + 1], nullptr, 10));
+        else if (std::strcmp(argv[i], "--megabytes") == 0) megabytes = static_cast<unsigned>(std::strtoul(argv[i + 1], nullptr, 10));
+    }
+    if (connections == 0) connections = 1;
+    uint64_t perConnection = static_cast<uint64_t>(megabytes) * 1024 * 1024 / connections;
+
+    try {
+        Result epoll = run(false, connections, perConnection);
+        Result ring = run(true, connections, perConnection);
+
+        std::printf("{\n  \"benchmark\": \"vpn_uring_bench\",\n  \"project\": \"%s\",\n", VPN_PROJECT);
+        std::printf("  \"connections\": %u,\n  \"bytes_per_connection\": %llu,\n  \"modes\": {\n",
+                    connections, static_cast<unsigned long long>(perConnection));
+        printResult("epoll_recv", epoll, false);
+        printResult("io_uring_multishot", ring, true);
+        std::printf("  }\n}\n");
+        return epoll.bytes == perConnection * connections &&
+               (!ring.available || ring.bytes == perConnection * connections) ? 0 : 1;
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "vpn_uring_bench: %s\n", e.what());
+        return 1;
+    }
+}
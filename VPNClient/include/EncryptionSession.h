@@ -0,0 +1,24 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <Poco/Crypto/Cipher.h> //Keeps the initialized cipher alive between packets.
+
+// Per-connection counterpart of `Encryption`.
+// The static `Encryption` methods rebuild the cipher (and rerun the passphrase key derivation)
+// on every call; a session derives the AES-256-CBC key once and reuses it for every packet.
+// Output is interchangeable with `Encryption::encrypt`/`decrypt` for the same key.
+class EncryptionSession {
+public:
+    // key - Passphrase the AES-256 key material is derived from (same meaning as in `Encryption`).
+    explicit EncryptionSession(const std::string& key);
+
+    // Encrypt the data with the session cipher
+    std::vector<uint8_t> encrypt(const std::vector<uint8_t>& data) const;
+
+    // Decrypt the data with the session cipher
+    std::vector<uint8_t> decrypt(const std::vector<uint8_t>& data) const;
+
+private:
+    Poco::Crypto::Cipher::Ptr cipher_; //Cipher created once from the derived key.
+};
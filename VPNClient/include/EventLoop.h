@@ -0,0 +1,107 @@
+#pragma once
+#include "IoUring.h"
+#include <Poco/Net/DatagramSocket.h>
+#include <Poco/Net/PollSet.h>
+#include <Poco/Net/ServerSocket.h>
+#include <Poco/Net/Socket.h>
+#include <Poco/Net/StreamSocket.h>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One thread polling many non-blocking sockets.
+//
+// Sockets are registered with the events they wait for and a handler that runs on the
+// loop thread when any of them (or an error) occurs. Everything that touches the poll
+// set runs on the loop thread; other threads hand work over with post(), which wakes
+// the loop through a loopback datagram socket. A loop drives thousands of connections,
+// so handlers must never block.
+//
+// Where IoUring::available(), the loop waits on an io_uring instead of epoll: socket
+// readiness becomes multishot polls, and everything queued while handling one batch of
+// events (new polls, sends, accepts) goes to the kernel with the next single
+// io_uring_enter(). Connections can also use the ring directly (ring(), addCompletion()).
+class EventLoop {
+public:
+    enum Event {
+        READABLE = Poco::Net::PollSet::POLL_READ,
+        WRITABLE = Poco::Net::PollSet::POLL_WRITE,
+        ERROR = Poco::Net::PollSet::POLL_ERROR
+    };
+
+    typedef std::function<void()> Task;
+    typedef std::function<void(int events)> Handler;
+    typedef std::function<void(const IoUring::Completion& completion)> CompletionHandler;
+    typedef std::function<void(const Poco::Net::StreamSocket& socket)> AcceptHandler;
+
+    // Starts the loop thread. Throws Poco::Exception if the wake-up socket cannot be bound.
+    EventLoop();
+    // Stops the loop; handlers still registered are dropped without being called.
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Runs `task` on the loop thread, after the tasks posted before it.
+    void post(Task task);
+    bool inLoop() const { return std::this_thread::get_id() == threadId_; }
+
+    // Loop thread only: watch `socket` for `events`, change them, stop watching.
+    void add(const Poco::Net::Socket& socket, int events, Handler handler);
+    void update(const Poco::Net::Socket& socket, int events);
+    void remove(const Poco::Net::Socket& socket);
+
+    // Loop thread only: accepts connections on `listener` and hands each to `handler`,
+    // with one multishot accept on io_uring or readiness and accept() on epoll.
+    void listen(const Poco::Net::ServerSocket& listener, AcceptHandler handler);
+
+    // The loop's io_uring, or null when it polls with epoll. Loop thread only.
+    IoUring* ring() { return ring_.get(); }
+    // Loop thread only: routes completions of ring operations queued with the returned
+    // user data to `handler`, until removeCompletion().
+    uint64_t addCompletion(CompletionHandler handler);
+    void removeCompletion(uint64_t userData);
+
+    // "io_uring" or "epoll".
+    const char* backend() const { return ring_ ? "io_uring" : "epoll"; }
+
+    // Sockets currently registered.
+    size_t load() const { return load_; }
+
+    void stop();
+
+private:
+    // A socket watched through the ring, by the user data of its multishot poll.
+    struct Watch {
+        uint64_t userData;
+        int events;
+    };
+
+    void run();
+    void runPoll();
+    void runRing();
+    void wake();
+    void drainWake();
+    void runTasks();
+    bool tasksPending();
+
+    Poco::Net::PollSet pollSet_;
+    std::map<Poco::Net::Socket, Handler> handlers_;
+    std::unique_ptr<IoUring> ring_;
+    std::map<Poco::Net::Socket, Watch> watches_;
+    std::map<uint64_t, CompletionHandler> completions_;
+    uint64_t nextUserData_;
+    Poco::Net::DatagramSocket wakeSocket_;
+    std::atomic<bool> wakePending_;
+    std::mutex tasksMutex_;
+    std::vector<Task> tasks_;
+    std::atomic<size_t> load_;
+    std::atomic<bool> running_;
+    std::thread::id threadId_;
+    std::thread thread_;
+};
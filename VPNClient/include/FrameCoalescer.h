@@ -0,0 +1,91 @@
+#pragma once
+#include "Framing.h"
+#include "RecordSizer.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Gathers small frames into one write, i.e. one TLS record and one syscall.
+//
+// Pending bytes are written when they would no longer fit into one record, when the
+// oldest pending frame has waited `delay`, or on flush(). In LATENCY_FIRST mode every
+// send is written immediately. Writes larger than a record bypass the buffer (after
+// the pending bytes), so ordering is always preserved. The record size follows a
+// RecordSizer: about one MSS after idle, growing to MAX_RECORD while data streams.
+//
+// Deadlines of all coalescers are kept by one shared timer thread, so a coalescer
+// costs no thread of its own. The writer is called without the lock that send()
+// takes: producers keep queueing frames while a slow write is in progress, and a
+// second lock keeps the writes in order.
+//
+// A failed write is reported by the next send/flush; the connection is unusable then.
+// Thread-safe: any number of threads may send through one coalescer.
+class FrameCoalescer {
+public:
+    // Writes `length` bytes to the connection; returns false on failure.
+    typedef std::function<bool(const uint8_t* data, size_t length)> Writer;
+
+    enum Mode {
+        THROUGHPUT,    // Batch frames until the record is full or the deadline passes.
+        LATENCY_FIRST  // Write every frame as soon as it is sent.
+    };
+
+    static const size_t MAX_RECORD = 16 * 1024; // Largest TLS record payload.
+
+    // delay - How long the first pending frame may wait for others to join it.
+    // records - When to switch between small and large records.
+    explicit FrameCoalescer(Writer writer, Mode mode = THROUGHPUT,
+                            std::chrono::microseconds delay = std::chrono::microseconds(100),
+                            const RecordSizer::Policy& records = RecordSizer::Policy());
+    // Writes whatever is still pending.
+    ~FrameCoalescer();
+
+    FrameCoalescer(const FrameCoalescer&) = delete;
+    FrameCoalescer& operator=(const FrameCoalescer&) = delete;
+
+    // Queues one frame. Returns false if the payload is too large or a write failed.
+    bool send(FrameType type, const uint8_t* payload, size_t length, uint8_t flags = 0);
+    // Queues raw bytes, e.g. an already framed or chunked message.
+    bool write(const uint8_t* data, size_t length);
+    // Writes everything pending now.
+    bool flush();
+
+    void setMode(Mode mode);
+    Mode mode() const;
+
+    // Writes issued and bytes queued so far.
+    uint64_t writes() const;
+    uint64_t bytes() const;
+    // Records written at each size.
+    RecordSizer::Stats recordStats() const;
+
+private:
+    // The process-wide thread that flushes coalescers whose deadline has passed.
+    class Timer;
+
+    bool queue(const uint8_t* header, size_t headerLength, const uint8_t* data, size_t length);
+    bool flushPending(bool onlyIfDue);
+    void takePendingLocked();
+    void armDeadlineLocked();
+    void updateLimitLocked();
+    // writeMutex_ held, mutex_ not held.
+    bool writeOut(const uint8_t* data, size_t length);
+    bool writeRecords(const uint8_t* data, size_t length);
+
+    Writer writer_;
+    Mode mode_;
+    std::chrono::microseconds delay_;
+    mutable std::mutex mutex_;    // Everything below except out_.
+    std::mutex writeMutex_;       // Held from taking bytes out of pending_ until they are written.
+    std::vector<uint8_t> pending_;
+    std::vector<uint8_t> out_;    // What is being written; only with writeMutex_.
+    std::chrono::steady_clock::time_point deadline_;
+    RecordSizer sizer_;
+    size_t limit_;           // Current record size.
+    bool failed_;
+    uint64_t writes_;
+    uint64_t bytes_;
+};
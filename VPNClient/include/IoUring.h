@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A minimal io_uring instance, driven with raw syscalls (no liburing).
+//
+// Operations are queued in the submission ring and reach the kernel in batches: one
+// io_uring_enter() submits everything queued since the last call and waits for
+// completions, however many sockets are involved. The operations used here:
+//   - multishot poll     readiness of sockets whose bytes still go through OpenSSL,
+//   - multishot accept   one submission accepts every incoming connection,
+//   - multishot receive  from a provided buffer ring: the kernel picks a buffer for each
+//                        completion, so idle connections pin no receive memory,
+//   - linked sends       a chain the kernel runs in order, stopping at the first failure.
+//
+// Compiled in with VPN_IO_URING (CMake option, Linux). available() also checks the
+// running kernel (5.19 or later); EventLoop falls back to epoll without it. One ring
+// belongs to one thread.
+class IoUring {
+public:
+    struct Completion {
+        uint64_t userData;
+        int32_t result;     // Bytes, accepted fd, poll mask, or -errno.
+        uint32_t flags;
+
+        // More completions follow for this multishot operation.
+        bool more() const;
+        // Provided buffer holding a receive's bytes, or -1.
+        int buffer() const;
+    };
+
+    struct Stats {
+        Stats() : enters(0), submitted(0), completed(0) {}
+
+        uint64_t enters;      // io_uring_enter() calls.
+        uint64_t submitted;   // Operations handed to the kernel.
+        uint64_t completed;   // Completions reaped.
+    };
+
+    static const unsigned DEFAULT_ENTRIES = 1024;
+    static const unsigned BUFFER_COUNT = 256;        // Provided receive buffers (a power of two).
+    static const size_t BUFFER_SIZE = 16 * 1024;      // One TLS record.
+    // User data of operations whose completions nobody wants (updates, removals, cancels).
+    static const uint64_t IGNORED = 0;
+
+    // Whether io_uring was compiled in and the kernel supports everything above.
+    // Checked once; VPN_NO_IO_URING in the environment turns it off.
+    static bool available();
+
+    // Throws std::runtime_error if the ring or its buffer ring cannot be set up.
+    explicit IoUring(unsigned entries = DEFAULT_ENTRIES);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Queue one operation each; they reach the kernel with the next submit() or wait().
+    void pollMultishot(int fd, uint32_t pollMask, uint64_t userData);
+    // Changes the events of the poll queued with `target`.
+    void pollUpdate(uint64_t target, uint32_t pollMask);
+    void pollRemove(uint64_t target);
+    void acceptMultishot(int fd, uint64_t userData);
+    void receiveMultishot(int fd, uint64_t userData);
+    // `linkNext` holds the next queued operation back until this one completes, and
+    // cancels it (-ECANCELED) if this one fails or comes up short.
+    void send(int fd, const void* data, size_t length, uint64_t userData, bool linkNext);
+    // Cancels every operation queued with `userData`.
+    void cancel(uint64_t userData);
+
+    // Bytes of a receive completion's buffer; hand it back with recycleBuffer() when done.
+    const uint8_t* bufferData(int buffer) const;
+    void recycleBuffer(int buffer);
+
+    // Submits what is queued without waiting. Returns false on a ring error.
+    bool submit();
+    // Submits what is queued, waits up to `timeoutMs` for a completion (0: no wait) and
+    // appends every completion ready to `completions`. Returns false on a ring error.
+    bool wait(int timeoutMs, std::vector<Completion>& completions);
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct Ring;
+
+    void* nextEntry();
+
+    std::unique_ptr<Ring> ring_;
+    Stats stats_;
+};
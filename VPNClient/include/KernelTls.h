@@ -0,0 +1,44 @@
+#pragma once
+#include <Poco/Net/Context.h>
+#include <Poco/Net/Socket.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Optional Linux kernel TLS (kTLS) offload.
+//
+// With kTLS enabled on a context, OpenSSL hands the negotiated record keys to the
+// kernel right after the handshake (setsockopt TCP_ULP "tls", then TLS_TX/TLS_RX).
+// From then on SSL_write/SSL_read only move plaintext with write()/recvmsg(), the
+// kernel does the record crypto, and files can go out with sendfile() without ever
+// entering user space.
+//
+// Compiled in with VPN_KTLS (CMake option, Linux and an OpenSSL built with kTLS).
+// Everything falls back to user-space TLS when the build, the kernel module or the
+// negotiated cipher does not support it; nothing here ever fails a connection.
+class KernelTls {
+public:
+    struct Status {
+        Status() : send(false), receive(false) {}
+
+        bool send;     // Kernel encrypts outgoing records.
+        bool receive;  // Kernel decrypts incoming records.
+
+        std::string toString() const;
+    };
+
+    // Whether kTLS was compiled in and the kernel offers the "tls" ULP
+    // (module loaded, or listed in /proc/sys/net/ipv4/tcp_available_ulp).
+    static bool available();
+
+    // Turns kTLS on for every connection made with `context`. Returns false (and leaves
+    // the context alone) if it is not available.
+    static bool enable(Poco::Net::Context& context);
+
+    // Which directions the kernel has taken over on a connected socket, after the handshake.
+    static Status status(const Poco::Net::Socket& socket);
+
+    // Sends `length` bytes of file `fd` from `offset` with sendfile(); the kernel encrypts
+    // them. Only valid when status(socket).send is true. Returns the bytes sent or -1.
+    static long sendFile(const Poco::Net::Socket& socket, int fd, int64_t offset, size_t length);
+};
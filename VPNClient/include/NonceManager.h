@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Builds 96-bit AEAD nonces for one direction of a session as
+//
+//     nonce = salt (SALT_SIZE) || packet counter (EXPLICIT_SIZE, big-endian)
+//
+// Only the counter travels on the wire. The salt is per direction, and the counter
+// only moves forward and cannot be set or copied, so a (key, nonce) pair can never
+// repeat. Sealing needs no RNG call at all.
+class NonceManager {
+public:
+    static const size_t SALT_SIZE = 4;
+    static const size_t EXPLICIT_SIZE = 8;
+    static const size_t NONCE_SIZE = SALT_SIZE + EXPLICIT_SIZE;
+
+    // salt - SALT_SIZE bytes, different for each direction of the session.
+    explicit NonceManager(const uint8_t* salt);
+
+    NonceManager(const NonceManager&) = delete;
+    NonceManager& operator=(const NonceManager&) = delete;
+
+    // Takes the next counter value and writes the full nonce.
+    // Returns false once the counter space is used up; the session must be rekeyed.
+    bool next(uint8_t* nonce, uint64_t& counter);
+
+    // Rebuilds the nonce for a counter read from a received packet.
+    void nonceFor(uint64_t counter, uint8_t* nonce) const;
+
+    // Number of nonces handed out so far.
+    uint64_t used() const { return counter_; }
+
+    static void writeCounter(uint64_t counter, uint8_t* out);
+    static uint64_t readCounter(const uint8_t* in);
+
+private:
+    uint8_t salt_[SALT_SIZE];
+    uint64_t counter_;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Picks the TLS record size for the next write on one connection.
+//
+// A fresh or idle connection uses small records that fit one TCP segment, so the
+// receiver can decrypt the first bytes without waiting for a full 16 KB record to
+// arrive over a cold congestion window. Once `growAfterBytes` have been sent without
+// a pause, records grow to the TLS maximum for throughput. After `idleTimeout`
+// without writes the connection starts small again.
+//
+// Not thread-safe; FrameCoalescer calls it under its own lock.
+class RecordSizer {
+public:
+    struct Policy {
+        Policy()
+            : smallRecord(1400)
+            , largeRecord(16 * 1024)
+            , growAfterBytes(128 * 1024)
+            , idleTimeout(std::chrono::milliseconds(1000)) {}
+
+        size_t smallRecord;     // Fits a 1460-byte MSS with the TLS header and AEAD tag.
+        size_t largeRecord;     // TLS maximum record payload.
+        size_t growAfterBytes;  // Bytes sent in small records before growing.
+        std::chrono::steady_clock::duration idleTimeout;
+    };
+
+    // Records counted per size: <= 512 B, 1 KB, 2 KB, 4 KB, 8 KB and 16 KB.
+    static const size_t SIZE_BUCKETS = 6;
+
+    struct Stats {
+        uint64_t smallRecords;  // Written while in the small-record phase.
+        uint64_t largeRecords;  // Written after growing.
+        uint64_t bySize[SIZE_BUCKETS];
+        uint64_t resets;        // Times the connection dropped back to small records.
+
+        std::string toString() const;
+    };
+
+    explicit RecordSizer(const Policy& policy = Policy());
+
+    // Largest record to write at `now`; drops back to small records after an idle period.
+    size_t recordLimit(std::chrono::steady_clock::time_point now);
+    // Accounts for one record of `length` bytes written at `now`.
+    void recorded(size_t length, std::chrono::steady_clock::time_point now);
+
+    bool large() const { return large_; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    Policy policy_;
+    bool large_;
+    size_t streamed_;
+    std::chrono::steady_clock::time_point lastWrite_;
+    Stats stats_;
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include "AeadCipher.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// AEAD session that periodically moves to a fresh key without dropping packets.
+//
+// Every key epoch gets its own AeadCipher, derived with HKDF-SHA256 from the session
+// secret and the epoch number. Packets carry the low byte of their epoch in front of
+// the AeadCipher header:
+//
+//     [ epoch (1) | packet counter (8) | payload | tag (16) ]
+//
+// The cipher for epoch N+1 is derived in the background as soon as epoch N starts, so
+// switching is usually just a pointer swap on the data path. All sessions share one
+// deriver thread: a rekey costs one HKDF and key setup every few minutes per session,
+// so the thread count stays flat however many clients there are. No key is ever
+// derived on the data path: a packet of epoch N+1 that arrives before the derivation
+// finished (only possible when rekeys follow each other within microseconds) is
+// dropped like any lost datagram. The previous epoch stays available for packets
+// still in flight. A side switches when its own byte or time budget runs out, whether or
+// not the peer sends anything back, or when it sees the peer already using the next
+// epoch. Whether the peer has used the current key only decides which key is kept as
+// the previous one: a peer that has not is still on the older key, so that one stays.
+// A receiver that lost every packet of an epoch finds the sender up to MAX_EPOCH_GAP
+// epochs ahead; that key is derived on the deriver too, and the packets that arrive
+// meanwhile are dropped.
+//
+// One thread may encrypt while another decrypts; each direction on its own is not thread-safe.
+class RekeyingCipher {
+public:
+    enum Role {
+        CLIENT,
+        SERVER
+    };
+
+    struct Policy {
+        Policy() : maxBytes(uint64_t(1) << 32), maxAge(120) {}
+
+        uint64_t maxBytes;           // Payload bytes sent under one key.
+        std::chrono::seconds maxAge; // Lifetime of one key.
+    };
+
+    static const size_t EPOCH_SIZE = 1;
+    static const size_t HEADROOM = EPOCH_SIZE + AeadCipher::HEADROOM;
+    static const size_t OVERHEAD = HEADROOM + AeadCipher::TAG_SIZE;
+
+    // secret - Session secret shared by both peers; only used as HKDF input.
+    // Throws std::runtime_error if the first epoch cannot be derived.
+    RekeyingCipher(AeadCipher::Algorithm algorithm, const uint8_t* secret, size_t secretLength,
+                   Role role, const Policy& policy = Policy());
+    ~RekeyingCipher();
+
+    RekeyingCipher(const RekeyingCipher&) = delete;
+    RekeyingCipher& operator=(const RekeyingCipher&) = delete;
+
+    // Same contract as AeadCipher::encrypt/decrypt with HEADROOM/OVERHEAD from this class.
+    size_t encrypt(uint8_t* buffer, size_t capacity, size_t payloadLength);
+    bool decrypt(uint8_t* buffer, size_t sealedLength, size_t& payloadLength, uint64_t* sequence = nullptr);
+
+    // Asks for a switch to the next epoch on the next packet sent.
+    void requestRekey();
+
+    uint32_t sendEpoch() const;
+    AeadCipher::Algorithm algorithm() const { return algorithm_; }
+
+private:
+    struct Epoch {
+        uint32_t number;
+        std::shared_ptr<AeadCipher> cipher;
+    };
+
+    // The process-wide background thread that runs deriveNext() for every session.
+    class Deriver;
+
+    std::shared_ptr<AeadCipher> derive(uint32_t epoch) const;
+    // Fills next_, and ahead_ if the peer was seen beyond it, while they are still empty;
+    // runs on the Deriver.
+    void deriveNext();
+    // Switches to `target`, one of next_ or ahead_.
+    void promoteLocked(Epoch target);
+
+    // How far beyond the current epoch a peer is followed after whole epochs were lost.
+    static const uint8_t MAX_EPOCH_GAP = 16;
+
+    AeadCipher::Algorithm algorithm_;
+    Role role_;
+    Policy policy_;
+    uint8_t secret_[64];
+    size_t secretLength_;
+
+    mutable std::mutex mutex_;
+    Epoch previous_;
+    Epoch current_;
+    Epoch next_;
+    Epoch ahead_;                // Epoch beyond next_ the peer was seen using; number 0 if none.
+    bool peerUsedCurrent_;
+    bool peerUsedPrevious_;
+    bool rekeyRequested_;
+    uint64_t bytesSent_;
+    std::chrono::steady_clock::time_point epochStart_;
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include "SessionStore.h"
+#include <Poco/Net/Session.h>
+#include <Poco/Net/SocketAddress.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Client-side TLS sessions, keyed by server endpoint ("host:port").
+//
+// A tunnel that reconnects to an endpoint it has talked to before offers the stored
+// session (a TLS 1.3 ticket), and the server resumes it with a PSK handshake: no
+// certificate is sent or verified. When the server also agrees to psk_ke (see
+// ContextCache) there is no key exchange either, so a reconnect storm after a server
+// restart costs the server symmetric crypto only.
+//
+// Tickets arrive after the handshake, so store the session with put() once the first
+// application data has been exchanged (or when closing), not right after connect.
+//
+// The cache also remembers the resolved address of each endpoint, so reconnects skip
+// DNS. With a SessionStore attached, both survive a client restart.
+class SessionCache {
+public:
+    static const size_t MAX_ENTRIES = 1024;
+
+    static SessionCache& instance();
+
+    static std::string endpoint(const std::string& host, int port);
+
+    // The stored session for `endpoint`, or null for a full handshake.
+    Poco::Net::Session::Ptr get(const std::string& endpoint) const;
+    // Stores `session` if it can be resumed; otherwise forgets the endpoint.
+    void put(const std::string& endpoint, Poco::Net::Session::Ptr session);
+    void remove(const std::string& endpoint);
+    void clear();
+    size_t size() const;
+
+    // Resolves `host`:`port`, reusing the last address found for it unless `fresh`.
+    // Callers retry with `fresh` when connecting to a remembered address fails.
+    Poco::Net::SocketAddress resolve(const std::string& host, int port, bool fresh = false);
+
+    // Reads through to and writes through to `store` from now on; null detaches it.
+    void setStore(std::shared_ptr<SessionStore> store);
+
+    // Counts the outcome of one handshake, for logging.
+    void recordHandshake(bool resumed);
+    uint64_t resumed() const { return resumed_; }
+    uint64_t fullHandshakes() const { return full_; }
+
+private:
+    SessionCache();
+    SessionCache(const SessionCache&) = delete;
+    SessionCache& operator=(const SessionCache&) = delete;
+
+    mutable std::mutex mutex_;
+    mutable std::map<std::string, Poco::Net::Session::Ptr> sessions_;
+    std::map<std::string, std::string> addresses_;
+    std::shared_ptr<SessionStore> store_;
+    std::atomic<uint64_t> resumed_;
+    std::atomic<uint64_t> full_;
+};
@@ -0,0 +1,114 @@
+#pragma once
+#include "Framing.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Logical streams multiplexed over one tunnel connection.
+//
+// Every stream has its own id and its own credit window: a sender may have at most
+// INITIAL_WINDOW unconsumed bytes in flight on a stream, and the receiver hands credit
+// back (FRAME_STREAM_CREDIT) as the application consumes them. A stream whose reader
+// stalls therefore only stops its own sender; the connection's reader never blocks on
+// it, and the other streams keep moving. All streams share one TLS session and one TCP
+// congestion window.
+//
+// Frame payloads start with the stream id (4 bytes, big-endian):
+//
+//     OPEN    [ id ]
+//     DATA    [ id | bytes ]
+//     CREDIT  [ id | bytes consumed (4) ]
+//     CLOSE   [ id ]             flags: STREAM_RESET aborts both directions
+//
+// Clients open odd ids, servers even ids. One thread feeds received STREAM_* frames to
+// handleFrame(); any thread may open, write, read and close. One writer per stream.
+class StreamMux {
+public:
+    enum Role { CLIENT, SERVER };
+
+    // Writes one frame on the connection. Called without the mux lock held.
+    typedef std::function<bool(FrameType type, uint8_t flags, const uint8_t* payload, size_t length)> Writer;
+    // Consumes stream data as it arrives instead of queueing it for read(); credit is
+    // returned at once. A zero length marks the end of the stream.
+    typedef std::function<void(uint32_t id, const uint8_t* data, size_t length)> Handler;
+
+    static const uint8_t STREAM_RESET = 0x01;
+    static const size_t ID_SIZE = 4;
+    static const size_t MAX_CHUNK = Framing::MAX_PAYLOAD - ID_SIZE;
+    static const uint32_t INITIAL_WINDOW = 256 * 1024;
+    static const size_t MAX_STREAMS = 256;
+
+    StreamMux(Role role, Writer writer);
+
+    static bool isStreamFrame(FrameType type);
+
+    // Delivers incoming data to `handler` instead of read(); streams the peer opens are
+    // then accepted implicitly. Set it before the first frame arrives.
+    void setHandler(Handler handler);
+
+    // Opens a stream. Returns its id, or 0 if too many streams are open or the write failed.
+    uint32_t open();
+    // Waits for a stream opened by the peer. Returns 0 on timeout or shutdown.
+    uint32_t accept(std::chrono::milliseconds timeout);
+
+    // Sends `length` bytes on stream `id`, waiting for credit as needed. Returns false if
+    // the stream is closed or reset, the connection failed, or `timeout` passed without credit.
+    bool write(uint32_t id, const uint8_t* data, size_t length, std::chrono::milliseconds timeout);
+    // Reads up to `capacity` bytes. Returns the byte count, 0 at the end of the stream,
+    // -1 on reset, timeout or shutdown.
+    int read(uint32_t id, uint8_t* buffer, size_t capacity, std::chrono::milliseconds timeout);
+    // Ends our direction of the stream; reset also discards the peer's direction.
+    void close(uint32_t id, bool reset = false);
+
+    // Processes one received STREAM_* frame. Returns false if the peer broke the protocol
+    // (data beyond its credit, bad id); the connection should then be dropped.
+    bool handleFrame(const FrameView& frame);
+
+    // Fails every stream and wakes all waiters, e.g. when the connection is gone.
+    void shutdown();
+
+    size_t streams() const;
+
+private:
+    struct Stream {
+        Stream() : sendCredit(INITIAL_WINDOW), receiveCredit(INITIAL_WINDOW), unreported(0),
+                   queueOffset(0), queued(0), localClosed(false), remoteClosed(false), reset(false) {}
+
+        uint32_t sendCredit;        // Bytes we may still send.
+        uint32_t receiveCredit;     // Bytes the peer may still send.
+        uint32_t unreported;        // Bytes consumed but not yet credited back.
+        std::deque<std::vector<uint8_t>> queue;
+        size_t queueOffset;         // Consumed part of queue.front().
+        size_t queued;
+        bool localClosed;
+        bool remoteClosed;
+        bool reset;
+    };
+    typedef std::shared_ptr<Stream> StreamPtr;
+
+    StreamPtr findLocked(uint32_t id) const;
+    bool peerId(uint32_t id) const;
+    // Counts consumed bytes; returns the credit to send now, or 0 to wait for more.
+    uint32_t consumedLocked(Stream& stream, size_t length);
+    void eraseIfDoneLocked(uint32_t id, const Stream& stream);
+
+    bool sendControl(FrameType type, uint8_t flags, uint32_t id, const uint32_t* value);
+
+    Role role_;
+    Writer writer_;
+    Handler handler_;
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::map<uint32_t, StreamPtr> streams_;
+    std::deque<uint32_t> accepted_;
+    uint32_t nextId_;
+    uint32_t highestPeerId_;
+    bool shutdown_;
+};
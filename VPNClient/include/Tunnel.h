@@ -1,8 +1,18 @@
 #pragma once
 #include <string> //Used for handling text data like the remote address of the server
 #include <vector> //Used for transmitting and receiving binary data as a dynamic array
+#include <memory> //Owns the send coalescer.
+#include <mutex> //Guards the frames queued by an attached tunnel...
+#include <condition_variable> //...and wakes receiveFrame() when one arrives.
+#include <deque> //Queue of those frames.
 //Poco's Secure Stream Socket, which provides secure, encrypted communication over a network.
 #include <Poco/Net/SecureServerSocket.h>
+#include "AsyncConnection.h" //Non-blocking connection driven by an event loop.
+#include "FrameCoalescer.h" //Batches small writes into one TLS record.
+#include "Framing.h" //Frame format and incremental parser.
+#include "KernelTls.h" //Optional kernel TLS offload.
+#include "SessionCache.h" //TLS tickets kept per server endpoint.
+#include "StreamMux.h" //Logical streams with their own flow control.
 
 // Declares the `Tunnel` class, which encapsulates the logic for creating, managing, and closing a secure tunnel using SSL/TLS.
 class Tunnel {
@@ -17,15 +27,112 @@ public:
     // port - Species the port number for communication.
     bool createTunnel(const std::string& remoteAddress, int port); 
 
-    //Returns `true` if the data is successfully sent; otherwise, `false`
+    //Returns `true` if the data is successfully queued; otherwise, `false`.
+    //Small writes are coalesced (see sendFrame); a write error shows up on a later call.
     bool sendData(const std::vector<uint8_t>& data);
 
     // Declares a method for receiving data through the secure tunnel
     std::vector<uint8_t> receiveData();
+
+    // Receives into a buffer owned by the caller, so the hot path allocates nothing.
+    // Returns the number of bytes received, 0 if the peer closed the connection or the tunnel
+    // is not connected, and -1 on error.
+    int receiveData(uint8_t* buffer, size_t capacity);
+
+    // Queues one frame. Small frames are gathered into one TLS record of up to 16 KB, written
+    // when it is full or ~100 microseconds after the first frame was queued (see FrameCoalescer).
+    // A frame is always written as a whole, so frames from different callers never interleave.
+    bool sendFrame(FrameType type, const uint8_t* payload, size_t length, uint8_t flags = 0);
+
+    // Returns the next complete frame, reading from the socket only when the bytes already
+    // received do not hold one. Handles frames split across reads and several frames per read.
+    // `frame` points into the tunnel's receive buffer and is valid until the next call.
+    // Do not mix with the raw receiveData() calls on the same tunnel.
+    // STREAM_* frames are not returned: they are handed to streams() on the way.
+    bool receiveFrame(FrameView& frame);
+
+    // Attached tunnel without a frame handler: waits up to `timeoutMs` until receiveFrame()
+    // has a frame or the close to report, so a reader can watch other conditions as well.
+    // Returns false on timeout.
+    bool waitForFrame(int timeoutMs);
+
+    // Logical streams multiplexed over this connection, each with its own credit window,
+    // so one slow reader does not hold up the others. Null until createTunnel() succeeds.
+    // Stream frames only arrive while some thread is in receiveFrame(), so keep one reader
+    // thread running while streams are in use.
+    StreamMux* streams() { return streams_.get(); }
+
+    // Hands the connection to an event loop, so one thread can drive many tunnels.
+    // Call it right after createTunnel(), before other threads use the tunnel.
+    // From then on no call blocks on the socket: sendData()/sendFrame() only queue, and
+    // received frames go to `onFrame` on the loop thread (STREAM_* frames to streams() first).
+    // Without `onFrame`, frames are queued and receiveFrame() waits on that queue instead.
+    // The raw receive calls and sendFile() return failure once attached.
+    // Do not close or destroy an attached tunnel from inside its own loop's handlers.
+    bool attach(EventLoop& loop,
+                AsyncConnection::FrameHandler onFrame = AsyncConnection::FrameHandler(),
+                AsyncConnection::CloseHandler onClose = AsyncConnection::CloseHandler());
+    bool attached() const { return connection_ != nullptr; }
+
+    // Writes every queued frame now, e.g. before waiting for a reply.
+    // On an attached tunnel, waits until the loop has handed them to TLS.
+    bool flush();
+
+    // Latency-first mode writes every send immediately instead of coalescing.
+    // Use it for interactive traffic where even microseconds of delay matter.
+    void setLatencyFirst(bool latencyFirst);
+
+    // How many TLS records were written at each size on this connection. Records start at about
+    // one MSS, grow to 16 KB while data streams and shrink again after a quiet period.
+    RecordSizer::Stats recordStats() const;
+
+    // Sends `length` bytes of the open file `fd`, starting at `offset`.
+    // With kernel TLS on the send side this is a plain sendfile(): the file never enters
+    // user space. Otherwise it is read and written through TLS in record-sized pieces.
+    bool sendFile(int fd, int64_t offset, size_t length);
+
+    // Which directions the kernel took over after the handshake ("off" without kTLS).
+    KernelTls::Status kernelTls() const { return kernelTls_; }
+
+    // Whether the last createTunnel() resumed a cached TLS session (no certificate
+    // exchange or verification) instead of doing a full handshake.
+    bool sessionResumed() const { return resumed_; }
+
+    // Keeps the newest TLS session of the connection in SessionCache now, e.g. once the
+    // server's first reply shows that its tickets have arrived. closeTunnel() does it too.
+    // On an attached tunnel the session is read on the loop thread.
+    void keepSession();
+
     void closeTunnel();
 
 private:
+    bool writeRecord(const uint8_t* data, size_t length); //Where the coalescer's records go.
+    void onAsyncFrame(const FrameView& frame); //Frame received by the event loop.
+    void onAsyncClose(); //The event loop closed the connection.
+    // Frame kept for receiveFrame() when an attached tunnel has no frame handler.
+    struct ReceivedFrame {
+        FrameType type;
+        uint8_t flags;
+        std::vector<uint8_t> payload;
+    };
+
     Poco::Net::SecureStreamSocket* socket_; //Represents the socket used for encrypted communication.
     bool isConnected_; //: Declares a ag to track the connection state of the tunnel.
    //`true`: The tunnel is active and connected. `false`: The tunnel is closed or not connected.
+    FrameParser parser_; //Bytes received but not yet returned as frames.
+    std::unique_ptr<FrameCoalescer> coalescer_; //All writes go through it, in order.
+    std::unique_ptr<StreamMux> streams_; //Streams of the current connection.
+    bool latencyFirst_; //Mode for the coalescer of the next connection.
+    KernelTls::Status kernelTls_; //Offload state of the current connection.
+    std::string endpoint_; //"host:port" key of the current connection in SessionCache.
+    bool resumed_; //The current connection resumed a cached session.
+
+    AsyncConnection::Ptr connection_; //Set by attach(); null for a blocking tunnel.
+    AsyncConnection::FrameHandler onFrame_; //Caller's frame handler, if any.
+    AsyncConnection::CloseHandler onClose_; //Caller's close handler, if any.
+    std::mutex inboxMutex_; //Guards inbox_ and connectionClosed_.
+    std::condition_variable inboxChanged_;
+    std::deque<ReceivedFrame> inbox_; //Frames waiting for receiveFrame().
+    ReceivedFrame received_; //Frame last returned by receiveFrame(); the view points into it.
+    bool connectionClosed_; //The event loop has closed the connection.
 };
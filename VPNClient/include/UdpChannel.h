@@ -0,0 +1,76 @@
+#pragma once
+#include "RekeyingCipher.h"
+#include <Poco/Net/DatagramSocket.h>
+#include <Poco/Timespan.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Session parameters for the UDP data channel. The server generates them per client
+// and sends them over the TLS control connection, so they are never seen in clear.
+struct UdpChannelParams {
+    static const size_t SECRET_SIZE = 32;
+    static const size_t ENCODED_SIZE = 8 + 2 + 1 + SECRET_SIZE;
+
+    uint64_t sessionId;
+    uint16_t port;
+    AeadCipher::Algorithm algorithm; // Chosen by the server, so both ends agree.
+    uint8_t secret[SECRET_SIZE];
+
+    // Fresh random session id and secret. Throws std::runtime_error if the RNG fails.
+    static UdpChannelParams generate(uint16_t port, AeadCipher::Algorithm algorithm);
+
+    std::vector<uint8_t> encode() const;
+    static bool parse(const uint8_t* data, size_t length, UdpChannelParams& params);
+};
+
+// One end of the UDP data channel. Every datagram is sealed on its own:
+//
+//     [ session id (8) | epoch (1) | packet counter (8) | type (1) | payload | tag (16) ]
+//
+// The session id (in clear) lets the server find the session for a datagram; everything
+// after it is a RekeyingCipher packet, so loss and reordering only cost the packets
+// concerned and replays are dropped. The packet type is inside the authenticated part.
+//
+// The channel does not own a socket; probe()/send() are helpers for a connected one.
+// Like RekeyingCipher, one thread may send while another receives.
+class UdpChannel {
+public:
+    enum PacketType : uint8_t {
+        UDP_PROBE = 0x01,      // Client asks whether the UDP path works.
+        UDP_PROBE_ACK = 0x02,  // Server answer to a probe.
+        UDP_DATA = 0x03        // Tunnel payload.
+    };
+
+    static const size_t SESSION_ID_SIZE = 8;
+    static const size_t HEADROOM = SESSION_ID_SIZE + RekeyingCipher::HEADROOM + 1;
+    static const size_t OVERHEAD = HEADROOM + AeadCipher::TAG_SIZE;
+    static const size_t MAX_DATAGRAM = 1472;  // 1500-byte MTU minus IPv4 and UDP headers.
+    static const size_t MAX_PAYLOAD = MAX_DATAGRAM - OVERHEAD;
+
+    // Throws std::runtime_error if the keys cannot be derived.
+    UdpChannel(const UdpChannelParams& params, RekeyingCipher::Role role);
+
+    UdpChannel(const UdpChannel&) = delete;
+    UdpChannel& operator=(const UdpChannel&) = delete;
+
+    uint64_t sessionId() const { return sessionId_; }
+
+    // Builds a datagram in `out`. Returns its length, or 0 if it does not fit.
+    size_t seal(PacketType type, const uint8_t* payload, size_t length, uint8_t* out, size_t capacity);
+    // Authenticates and decrypts a datagram in place. On success `payload` points into it.
+    bool open(uint8_t* datagram, size_t length, PacketType& type, const uint8_t*& payload, size_t& payloadLength);
+
+    // Reads the session id of a datagram without authenticating it.
+    static bool peekSessionId(const uint8_t* datagram, size_t length, uint64_t& sessionId);
+
+    // Client side: sends up to `attempts` probes on a connected socket and waits `timeout`
+    // for an acknowledgement after each. Returns false if UDP does not get through.
+    bool probe(Poco::Net::DatagramSocket& socket, int attempts, const Poco::Timespan& timeout);
+    // Seals and sends one packet on a connected socket.
+    bool send(Poco::Net::DatagramSocket& socket, PacketType type, const uint8_t* payload, size_t length);
+
+private:
+    uint64_t sessionId_;
+    RekeyingCipher cipher_;
+};
@@ -1,22 +1,146 @@
 #pragma once
-#include "Tunnel.h" //For secure tunneling functionality.
-#include "VPNClient.h"    
-#include "Encryption.h" //For data encryption and decryption
+#include "EncryptionSession.h" //Inner encryption layer, only used if the server asks for it.
+#include "EventLoop.h" //Owns the TLS socket once connected.
+#include "Framing.h" //Frame format and incremental parser for the TLS stream.
+#include "PacketSource.h" //IP packets of the data plane (TUN device or memory).
+#include "ProtectionMode.h" //Negotiates single or double encryption with the server.
+#include "Tunnel.h" //TLS connection with coalesced writes, attached to the event loop.
+#include "UdpChannel.h" //Per-packet AEAD datagrams for the UDP data channel.
+#include <Poco/Net/DatagramSocket.h> //UDP socket of the data channel.
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string> //To handle text data (server address, encryption key).
+#include <vector>
 
-class VPNClient {
+class VPNClient {     //`VPNClient` class manages a secure VPN connection using SSL/TLS
 public:
-    VPNClient();
+    //Takes server address and port as input. `encryptionKey` enables the inner encryption layer.
+    //`enableUdp` asks for a UDP data channel; TCP is used if the server does not answer over UDP.
+    VPNClient(const std::string& address, uint16_t port, const std::string& encryptionKey = "", bool enableUdp = true);
     ~VPNClient();
 
-    bool connect(const std::string& serverAddress, int port); //Establishes a secure connection to the server.Returns `true` if successful.
-    void disconnect(); //Closes the connection and releases resources.
-    bool sendSecureData(const std::vector<uint8_t>& data); //Encrypts and sends data through the secure tunnel. Returns `true` on success.
-    std::vector<uint8_t> receiveSecureData(); //Receives encrypted data, decrypts it, and returns the result.
+    VPNClient(const VPNClient&) = delete;
+    VPNClient& operator=(const VPNClient&) = delete;
+
+    //Establishes a secure connection with the server , Completes the SSL handshake for authentication
+    bool connect();
+    // Connects and sends `firstData` as the first tunnel data. With early data enabled
+    // (and no inner layer) it leaves in the same TLS record as the protection offer,
+    // before the server has answered; otherwise it is sent once connect() is done.
+    bool connect(const std::vector<uint8_t>& firstData);
+    // Safely terminates the connection and cleans up resources.
+    void disconnect();
+
+    bool sendData(const std::vector<uint8_t>& data);
+    // Reads the next data frame from the server. Keep-alive responses are consumed here.
+    std::vector<uint8_t> receiveData();
+    // Sends data with the protection agreed in connect(): TLS alone, or the inner layer on top.
+    bool sendSecureData(const std::vector<uint8_t>& data);
+    // Receives data and removes the inner layer if one was agreed. Data that fails to
+    // decrypt is logged and dropped, and the next data is returned instead.
+    std::vector<uint8_t> receiveSecureData();
+
+    // Carries IP packets between `source` (normally a TunDevice) and the server until the
+    // connection drops or `source` is closed. Returns true if `source` was closed.
+    bool runPacketTunnel(PacketSource& source);
+    // Same for the queues of a multi-queue device (TunDevice::openQueues). One worker per
+    // queue reads its packets a batch at a time and hands the batch to the one sender
+    // (UDP when the channel is up), flushing once per batch; this thread writes the server's packets into the
+    // queue of their flow, so each flow stays with one worker. With a UDP channel one
+    // more thread does the same for the packets the server sends as datagrams.
+    bool runPacketTunnel(PacketQueues& queues);
+
+    // Writes all queued frames now.
+    bool flush();
+
+    // Early data: connect() sends the protection offer, the UDP request and its first data
+    // in one flight instead of one round trip each. Only takes effect without an inner
+    // encryption key, where the offer is TLS only and nothing depends on the answer.
+    void setEarlyData(bool enabled);
+    // Latency-first mode writes every frame immediately; the default coalesces small frames
+    // into one TLS record for up to ~100 microseconds.
+    void setLatencyFirst(bool enabled);
+    // TLS records written at each size on the current connection.
+    RecordSizer::Stats recordStats() const;
+
+    // Whether data currently goes over the UDP data channel.
+    bool usingUdp() const { return udpActive; }
+    bool isActive() const { return isConnected; }
+
+    // Implement ping to keep connection alive
+    void keepAlive();
 
 private:
-    Tunnel tunnel_; //Manages the secure tunnel for communication.
-    std::string encryptionKey_; //Stores the encryption key for secure data transmission.
-    bool isConnected_; //Tracks the connection state of the client.
-    bool authenticate(); //Handles user authentication before establishing a connection.
+    // What receivePacket() got from the server.
+    enum ReceiveResult {
+        RECEIVED,   // Data for the caller, with the inner layer removed.
+        SKIPPED,    // Nothing to deliver: a keep-alive answer, or data that failed to decrypt.
+        CLOSED      // The connection is gone.
+    };
+
+    // Queues the offer of every mode this client can run.
+    // TLS alone is always offered; the inner layer only when a key is configured.
+    void sendOffer();
+    // Waits for the server's choice of protection mode.
+    bool negotiateProtection();
+    // Asks the server for a UDP data channel (unless the request already went out with
+    // the first flight) and checks that datagrams get through.
+    // Without an answer (UDP blocked, server without UDP) all data stays on TCP.
+    void setupUdp(bool requested);
+    // Queues one frame. Frames from sendData() and keepAlive() share TLS records, and a
+    // frame is always written as a whole, so they never interleave on the wire.
+    // Throws Poco::IOException if an earlier write failed.
+    void sendFrame(FrameType type, const uint8_t* payload, size_t length);
+    // Queues `data` as DATA frames of at most MAX_PAYLOAD bytes each.
+    void queueData(const std::vector<uint8_t>& data);
+    // Returns the next frame the event loop received. `frame` is valid until the next call.
+    bool receiveFrame(FrameView& frame);
+    // Sends one datagram if the UDP channel is up and `data` fits. Returns false if the
+    // caller has to use TCP; a failed send also switches the channel off.
+    bool sendOverUdp(const uint8_t* data, size_t length);
+    // Sends the packets of one batch in order, holding sendMutex, so the workers of all
+    // queues share one sender. False once a packet could not be sent.
+    bool sendBatch(const PacketBatch& batch);
+    // Sends one packet of the data plane with the agreed protection, without the copy
+    // sendSecureData() makes when TLS is the only layer. Caller holds sendMutex.
+    bool sendPacket(const uint8_t* packet, size_t length);
+    // Reads one frame and removes the inner layer. A packet that fails to decrypt only
+    // costs itself; the tunnel ends on CLOSED alone.
+    ReceiveResult receivePacket(std::vector<uint8_t>& packet);
+    // Downlink of the UDP data channel: writes the packets of UDP_DATA datagrams into
+    // `queues` until `stop` is set. Probe answers are reported to keepAlive().
+    void receiveUdp(PacketQueues& queues, const std::atomic<bool>& stop);
+
+    static const int UDP_PROBE_ATTEMPTS = 3;
+    static const long UDP_PROBE_TIMEOUT_US = 200000; // Per attempt; a lost probe is retried.
+    static const long UDP_RECEIVE_TIMEOUT_US = 500000; // How soon receiveUdp() notices `stop`.
+    static const int DOWNLINK_POLL_MS = 500; // How soon runPacketTunnel() notices an uplink ended.
+
+    std::string serverAddress;    // Server's IP or hostname.
+    uint16_t serverPort;          // Server's port number.
+    std::atomic<bool> isConnected; // Connection status; read by the uplink and keep-alive threads.
+    // The only thread that reads or writes the TLS socket. Senders queue frames through the
+    // tunnel's coalescer and readers wait for the frames the loop received, so the uplink,
+    // keep-alive and coalescer timer threads never call into OpenSSL next to the downlink.
+    std::unique_ptr<EventLoop> loop;
+    std::unique_ptr<Tunnel> tunnel; // Current connection, attached to `loop`; null when disconnected.
+    bool latencyFirst;            // Write each frame at once instead of coalescing.
+    bool earlyData;               // Pipeline the first flight in connect(); see setEarlyData().
+    std::string encryptionKey;    // Passphrase for the inner encryption layer; empty disables it.
+    ProtectionMode protectionMode; // Mode agreed with the server in connect().
+    std::unique_ptr<EncryptionSession> session; // Inner layer, only for PROTECTION_DOUBLE.
+    bool udpWanted;               // Ask the server for a UDP data channel in connect().
+    Poco::Net::DatagramSocket udpSocket; // Connected to the server's UDP port.
+    std::unique_ptr<UdpChannel> udp; // Seals datagrams; null if UDP was never set up.
+    std::atomic<bool> udpActive;  // Data goes over UDP; false means TCP fallback.
+    // Serialises the data plane's senders: the workers of every queue, and sendSecureData()
+    // with the inner layer, whose cipher is not shared between threads.
+    std::mutex sendMutex;
+    std::mutex udpMutex;          // Senders and the keep-alive probe share the channel.
+    // While receiveUdp() runs it is the only reader of udpSocket; keepAlive() then only
+    // sends its probe and learns from udpProbeAnswered whether the last one came back.
+    std::atomic<bool> udpReceiving;
+    std::atomic<bool> udpProbeAnswered;
 };
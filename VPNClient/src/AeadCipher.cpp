@@ -0,0 +1,144 @@
+#include "AeadCipher.h"
+#include <openssl/evp.h>
+#include <climits>
+#include <stdexcept>
+
+#if defined(__GNUC__)
+#define AEAD_PREFETCH(address) __builtin_prefetch(address, 1)
+#else
+#define AEAD_PREFETCH(address) ((void)(address))
+#endif
+
+namespace {
+
+const EVP_CIPHER* evpCipher(AeadCipher::Algorithm algorithm) {
+    return algorithm == AeadCipher::CHACHA20_POLY1305 ? EVP_chacha20_poly1305() : EVP_aes_256_gcm();
+}
+
+}
+
+AeadCipher::AeadCipher(Algorithm algorithm, const uint8_t* key, const uint8_t* sendSalt, const uint8_t* receiveSalt)
+    : algorithm_(algorithm)
+    , encryptCtx_(EVP_CIPHER_CTX_new())
+    , decryptCtx_(EVP_CIPHER_CTX_new())
+    , sendNonces_(sendSalt)
+    , receiveNonces_(receiveSalt) {
+    // Both contexts keep their key schedule; per packet only the nonce is reloaded.
+    if (!encryptCtx_ || !decryptCtx_
+        || EVP_EncryptInit_ex(encryptCtx_, evpCipher(algorithm), nullptr, key, nullptr) != 1
+        || EVP_DecryptInit_ex(decryptCtx_, evpCipher(algorithm), nullptr, key, nullptr) != 1) {
+        EVP_CIPHER_CTX_free(encryptCtx_);
+        EVP_CIPHER_CTX_free(decryptCtx_);
+        throw std::runtime_error(std::string("AEAD setup failed: ") + algorithmName(algorithm));
+    }
+}
+
+AeadCipher::~AeadCipher() {
+    EVP_CIPHER_CTX_free(encryptCtx_);
+    EVP_CIPHER_CTX_free(decryptCtx_);
+}
+
+const char* AeadCipher::algorithmName(Algorithm algorithm) {
+    return algorithm == CHACHA20_POLY1305 ? "chacha20-poly1305" : "aes-256-gcm";
+}
+
+size_t AeadCipher::encrypt(uint8_t* buffer, size_t capacity, size_t payloadLength) {
+    if (capacity < OVERHEAD || payloadLength > capacity - OVERHEAD) return 0;
+
+    uint8_t nonce[NONCE_SIZE];
+    uint64_t counter = 0;
+    if (!sendNonces_.next(nonce, counter)) return 0;
+    NonceManager::writeCounter(counter, buffer);
+
+    // The counter is bound through the nonce, so it needs no separate authentication.
+    uint8_t* payload = buffer + HEADROOM;
+    if (!seal(nonce, nullptr, 0, payload, payloadLength, payload + payloadLength)) return 0;
+    return payloadLength + OVERHEAD;
+}
+
+bool AeadCipher::decrypt(uint8_t* buffer, size_t sealedLength, size_t& payloadLength, uint64_t* sequence) {
+    if (sealedLength < OVERHEAD) return false;
+
+    uint64_t counter = NonceManager::readCounter(buffer);
+    if (!replayWindow_.check(counter)) return false;
+
+    uint8_t nonce[NONCE_SIZE];
+    receiveNonces_.nonceFor(counter, nonce);
+
+    size_t length = sealedLength - OVERHEAD;
+    uint8_t* payload = buffer + HEADROOM;
+    if (!open(nonce, nullptr, 0, payload, length, payload + length)) return false;
+    replayWindow_.update(counter);
+    payloadLength = length;
+    if (sequence) *sequence = counter;
+    return true;
+}
+
+size_t AeadCipher::encryptBatch(AeadPacket* packets, size_t count) {
+    size_t succeeded = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        AeadPacket& packet = packets[i];
+        if (i + 1 < count) {
+            AEAD_PREFETCH(packets[i + 1].buffer);
+        }
+
+        size_t sealedLength = encrypt(packet.buffer, packet.capacity, packet.length);
+        packet.ok = sealedLength != 0;
+        if (packet.ok) {
+            packet.sequence = NonceManager::readCounter(packet.buffer);
+            packet.length = sealedLength;
+            ++succeeded;
+        }
+    }
+    return succeeded;
+}
+
+size_t AeadCipher::decryptBatch(AeadPacket* packets, size_t count) {
+    size_t succeeded = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        AeadPacket& packet = packets[i];
+        if (i + 1 < count) {
+            AEAD_PREFETCH(packets[i + 1].buffer);
+        }
+
+        size_t payloadLength = 0;
+        packet.ok = decrypt(packet.buffer, packet.length, payloadLength, &packet.sequence);
+        if (packet.ok) {
+            packet.length = payloadLength;
+            ++succeeded;
+        }
+    }
+    return succeeded;
+}
+
+bool AeadCipher::seal(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+                      uint8_t* data, size_t length, uint8_t* tag) {
+    if (length > INT_MAX || aadLength > INT_MAX) return false;
+
+    int outLength = 0;
+    int finalLength = 0;
+    if (EVP_EncryptInit_ex(encryptCtx_, nullptr, nullptr, nullptr, nonce) != 1) return false;
+    if (aadLength > 0
+        && EVP_EncryptUpdate(encryptCtx_, nullptr, &outLength, aad, static_cast<int>(aadLength)) != 1) return false;
+    if (EVP_EncryptUpdate(encryptCtx_, data, &outLength, data, static_cast<int>(length)) != 1) return false;
+    if (EVP_EncryptFinal_ex(encryptCtx_, data + outLength, &finalLength) != 1) return false;
+    return EVP_CIPHER_CTX_ctrl(encryptCtx_, EVP_CTRL_AEAD_GET_TAG, static_cast<int>(TAG_SIZE), tag) == 1;
+}
+
+bool AeadCipher::open(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+                      uint8_t* data, size_t length, const uint8_t* tag) {
+    if (length > INT_MAX || aadLength > INT_MAX) return false;
+
+    int outLength = 0;
+    int finalLength = 0;
+    if (EVP_DecryptInit_ex(decryptCtx_, nullptr, nullptr, nullptr, nonce) != 1) return false;
+    if (aadLength > 0
+        && EVP_DecryptUpdate(decryptCtx_, nullptr, &outLength, aad, static_cast<int>(aadLength)) != 1) return false;
+    if (EVP_DecryptUpdate(decryptCtx_, data, &outLength, data, static_cast<int>(length)) != 1) return false;
+    if (EVP_CIPHER_CTX_ctrl(decryptCtx_, EVP_CTRL_AEAD_SET_TAG, static_cast<int>(TAG_SIZE),
+                            const_cast<uint8_t*>(tag)) != 1) return false;
+    // A failed final step means the tag did not verify.
+    return EVP_DecryptFinal_ex(decryptCtx_, data + outLength, &finalLength) == 1;
+}
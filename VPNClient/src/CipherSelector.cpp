@@ -0,0 +1,162 @@
+#include "CipherSelector.h"
+#include <openssl/ssl.h>
+#include <chrono>
+#include <sstream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CIPHER_SELECTOR_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace {
+
+const size_t BENCH_PACKET_SIZE = 1400;
+const std::chrono::milliseconds BENCH_DURATION(20);
+
+// Suites shared by both orders; anything the peers still need falls through to the generic list.
+const char* AES_GCM_TLS12 = "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+                            "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256";
+const char* CHACHA_TLS12 = "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305";
+const char* FALLBACK_TLS12 = "ALL:!ADH:!LOW:!EXP:!MD5";
+const char* AES_GCM_TLS13 = "TLS_AES_256_GCM_SHA384:TLS_AES_128_GCM_SHA256";
+const char* CHACHA_TLS13 = "TLS_CHACHA20_POLY1305_SHA256";
+
+#if defined(CIPHER_SELECTOR_X86)
+void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) {
+#if defined(_MSC_VER)
+    __cpuidex(reinterpret_cast<int*>(regs), static_cast<int>(leaf), static_cast<int>(subleaf));
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+unsigned long long xgetbv0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+// Megabytes per second sealing BENCH_PACKET_SIZE packets in place for BENCH_DURATION.
+double measure(AeadCipher::Algorithm algorithm) {
+    uint8_t key[AeadCipher::KEY_SIZE] = {0};
+    uint8_t salt[AeadCipher::SALT_SIZE] = {0};
+    AeadCipher cipher(algorithm, key, salt, salt);
+    std::vector<uint8_t> buffer(BENCH_PACKET_SIZE + AeadCipher::OVERHEAD, 0x5A);
+
+    size_t packets = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::duration::zero();
+    do {
+        for (int i = 0; i < 64; ++i) {
+            cipher.encrypt(buffer.data(), buffer.size(), BENCH_PACKET_SIZE);
+        }
+        packets += 64;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < BENCH_DURATION);
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    return packets * BENCH_PACKET_SIZE / seconds / 1e6;
+}
+
+}
+
+CpuFeatures CpuFeatures::detect() {
+    CpuFeatures features;
+#if defined(CIPHER_SELECTOR_X86)
+    unsigned regs[4] = {0};
+    cpuid(0, 0, regs);
+    unsigned maxLeaf = regs[0];
+
+    cpuid(1, 0, regs);
+    features.aesni = (regs[2] >> 25) & 1;
+    features.pclmul = (regs[2] >> 1) & 1;
+    bool osxsave = (regs[2] >> 27) & 1;
+
+    // AVX state must be enabled by the OS (XCR0), not just supported by the CPU.
+    unsigned long long xcr0 = osxsave ? xgetbv0() : 0;
+    bool ymmState = (xcr0 & 0x6) == 0x6;
+    bool zmmState = (xcr0 & 0xE6) == 0xE6;
+
+    if (maxLeaf >= 7) {
+        cpuid(7, 0, regs);
+        features.avx2 = ymmState && ((regs[1] >> 5) & 1);
+        features.avx512f = zmmState && ((regs[1] >> 16) & 1);
+        features.vaes = ymmState && ((regs[2] >> 9) & 1);
+        features.vpclmulqdq = ymmState && ((regs[2] >> 10) & 1);
+    }
+#elif defined(__aarch64__) && defined(__linux__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    features.aesni = (hwcap & HWCAP_AES) != 0;
+    features.pclmul = (hwcap & HWCAP_PMULL) != 0;
+#endif
+    return features;
+}
+
+std::string CpuFeatures::toString() const {
+    std::string result;
+    const std::pair<bool, const char*> flags[] = {
+        {aesni, "aes"}, {pclmul, "pclmul"}, {avx2, "avx2"},
+        {avx512f, "avx512f"}, {vaes, "vaes"}, {vpclmulqdq, "vpclmulqdq"}
+    };
+    for (const auto& flag : flags) {
+        if (!flag.first) continue;
+        if (!result.empty()) result += ' ';
+        result += flag.second;
+    }
+    return result.empty() ? "none" : result;
+}
+
+const CipherSelector& CipherSelector::instance() {
+    static const CipherSelector selector;
+    return selector;
+}
+
+CipherSelector::CipherSelector()
+    : features_(CpuFeatures::detect())
+    , aesGcmMBps_(measure(AeadCipher::AES_256_GCM))
+    , chachaMBps_(measure(AeadCipher::CHACHA20_POLY1305)) {
+    preferred_ = aesGcmMBps_ >= chachaMBps_ ? AeadCipher::AES_256_GCM : AeadCipher::CHACHA20_POLY1305;
+
+    bool aesFirst = preferred_ == AeadCipher::AES_256_GCM;
+    tlsCipherList_ = std::string(aesFirst ? AES_GCM_TLS12 : CHACHA_TLS12) + ":"
+        + (aesFirst ? CHACHA_TLS12 : AES_GCM_TLS12) + ":" + FALLBACK_TLS12;
+    tlsCipherSuites_ = std::string(aesFirst ? AES_GCM_TLS13 : CHACHA_TLS13) + ":"
+        + (aesFirst ? CHACHA_TLS13 : AES_GCM_TLS13);
+}
+
+bool CipherSelector::applyTo(Poco::Net::Context& context) const {
+    bool applied = SSL_CTX_set_ciphersuites(context.sslContext(), tlsCipherSuites_.c_str()) == 1;
+    if (!applied) {
+        // Rejected (e.g. a build without ChaCha20): put OpenSSL's own order back explicitly
+        // rather than depend on what a failed call left behind.
+        SSL_CTX_set_ciphersuites(context.sslContext(), TLS_DEFAULT_CIPHERSUITES);
+    }
+    if (context.isForServerUse()) {
+        context.preferServerCiphers();
+    }
+    return applied;
+}
+
+std::string CipherSelector::describe() const {
+    std::ostringstream out;
+    out.precision(0);
+    out << std::fixed
+        << "cpu features: " << features_.toString()
+        << "; aes-256-gcm " << aesGcmMBps_ << " MB/s"
+        << ", chacha20-poly1305 " << chachaMBps_ << " MB/s"
+        << "; using " << AeadCipher::algorithmName(preferred_);
+    return out.str();
+}
@@ -0,0 +1,42 @@
+#include "EncryptionSession.h" //Declares the `EncryptionSession` class.
+#include <Poco/Crypto/CipherFactory.h>
+#include <Poco/Crypto/CipherKey.h>
+#include <stdexcept> //to report errors or exception
+
+// Runs the passphrase key derivation once for the whole session.
+EncryptionSession::EncryptionSession(const std::string& key) {
+    try {
+        cipher_ = Poco::Crypto::CipherFactory::defaultFactory().createCipher(
+            Poco::Crypto::CipherKey("aes-256-cbc", key)
+        );
+    }
+    catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Encryption session setup failed: ") + e.what());
+    }
+}
+
+//Encrypts the input data with the cipher created in the constructor.
+std::vector<uint8_t> EncryptionSession::encrypt(const std::vector<uint8_t>& data) const {
+    try {
+        std::string encrypted = cipher_->encryptString(
+            std::string(reinterpret_cast<const char*>(data.data()), data.size())
+        );
+        return std::vector<uint8_t>(encrypted.begin(), encrypted.end());
+    }
+    catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Encryption failed: ") + e.what());
+    }
+}
+
+// Decrypts the encrypted data with the cipher created in the constructor.
+std::vector<uint8_t> EncryptionSession::decrypt(const std::vector<uint8_t>& data) const {
+    try {
+        std::string decrypted = cipher_->decryptString(
+            std::string(reinterpret_cast<const char*>(data.data()), data.size())
+        );
+        return std::vector<uint8_t>(decrypted.begin(), decrypted.end());
+    }
+    catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Decryption failed: ") + e.what());
+    }
+}
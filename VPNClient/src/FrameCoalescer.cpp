@@ -0,0 +1,295 @@
+#include "FrameCoalescer.h"
+#include <condition_variable>
+#include <map>
+#include <thread>
+#include <utility>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// By value, so the static constants need no out-of-class definition.
+size_t smaller(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+}
+
+// Flushes coalescers when their deadline passes, for all of them on one thread.
+// A deadline that was met by an earlier flush simply finds nothing to do. cancel()
+// drops a coalescer's deadlines and waits if it is being flushed right now, so a
+// destroyed coalescer is never touched.
+class FrameCoalescer::Timer {
+public:
+    static Timer& instance() {
+        // Never destroyed: coalescers held by other static objects may outlive it.
+        static Timer* timer = new Timer();
+        return *timer;
+    }
+
+    void schedule(FrameCoalescer* coalescer, Clock::time_point deadline) {
+        bool earliest;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            earliest = due_.empty() || deadline < due_.begin()->first;
+            due_.emplace(deadline, coalescer);
+        }
+        if (earliest) wake_.notify_one();
+    }
+
+    void cancel(FrameCoalescer* coalescer) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (auto entry = due_.begin(); entry != due_.end(); ) {
+            if (entry->second == coalescer) entry = due_.erase(entry);
+            else ++entry;
+        }
+        done_.wait(lock, [this, coalescer] { return running_ != coalescer; });
+    }
+
+private:
+    Timer()
+        : running_(nullptr)
+        , thread_(&Timer::run, this) {}
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            if (due_.empty()) {
+                wake_.wait(lock);
+                continue;
+            }
+            Clock::time_point deadline = due_.begin()->first;
+            if (Clock::now() < deadline) {
+                wake_.wait_until(lock, deadline);
+                continue;
+            }
+            FrameCoalescer* coalescer = due_.begin()->second;
+            due_.erase(due_.begin());
+            running_ = coalescer;
+            lock.unlock();
+            coalescer->flushPending(true);
+            lock.lock();
+            running_ = nullptr;
+            done_.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;    // An earlier deadline was scheduled.
+    std::condition_variable done_;    // running_ finished.
+    std::multimap<Clock::time_point, FrameCoalescer*> due_;
+    FrameCoalescer* running_;
+    std::thread thread_;
+};
+
+FrameCoalescer::FrameCoalescer(Writer writer, Mode mode, std::chrono::microseconds delay,
+                               const RecordSizer::Policy& records)
+    : writer_(std::move(writer))
+    , mode_(mode)
+    , delay_(delay)
+    , sizer_(records)
+    , limit_(smaller(records.smallRecord, MAX_RECORD))
+    , failed_(false)
+    , writes_(0)
+    , bytes_(0) {
+    pending_.reserve(MAX_RECORD);
+    out_.reserve(MAX_RECORD);
+}
+
+FrameCoalescer::~FrameCoalescer() {
+    Timer::instance().cancel(this);
+    flushPending(false);
+}
+
+bool FrameCoalescer::send(FrameType type, const uint8_t* payload, size_t length, uint8_t flags) {
+    if (length > Framing::MAX_PAYLOAD) return false;
+    uint8_t header[Framing::HEADER_SIZE];
+    Framing::writeHeader(type, flags, length, header);
+    return queue(header, sizeof(header), payload, length);
+}
+
+bool FrameCoalescer::write(const uint8_t* data, size_t length) {
+    return queue(nullptr, 0, data, length);
+}
+
+bool FrameCoalescer::flush() {
+    return flushPending(false);
+}
+
+void FrameCoalescer::setMode(Mode mode) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        mode_ = mode;
+    }
+    if (mode == LATENCY_FIRST) flushPending(false);
+}
+
+FrameCoalescer::Mode FrameCoalescer::mode() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return mode_;
+}
+
+uint64_t FrameCoalescer::writes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return writes_;
+}
+
+uint64_t FrameCoalescer::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+RecordSizer::Stats FrameCoalescer::recordStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sizer_.stats();
+}
+
+// Queues `header` (a frame header, or nothing for raw bytes) followed by `data`.
+bool FrameCoalescer::queue(const uint8_t* header, size_t headerLength, const uint8_t* data, size_t length) {
+    size_t total = headerLength + length;
+    {
+        // Common case: the bytes join the pending record and nothing is written yet.
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (failed_) return false;
+        updateLimitLocked();
+        if (mode_ == THROUGHPUT && pending_.size() + total < limit_) {
+            pending_.insert(pending_.end(), header, header + headerLength);
+            pending_.insert(pending_.end(), data, data + length);
+            bytes_ += total;
+            armDeadlineLocked();
+            return true;
+        }
+    }
+
+    // Something has to be written. Whatever is taken out of pending_ here is written
+    // before anything queued after it, because writeMutex_ is held until it is.
+    std::lock_guard<std::mutex> order(writeMutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (failed_) return false;
+    updateLimitLocked();
+    bytes_ += total;
+    bool frame = headerLength > 0;
+    if (frame && total >= limit_) {
+        // A large frame: header and payload go out in the same record; only the
+        // payload tail spills over.
+        size_t head = smaller(limit_ - headerLength, length);
+        takePendingLocked();
+        lock.unlock();
+        if (!out_.empty() && !writeOut(out_.data(), out_.size())) return false;
+        out_.assign(header, header + headerLength);
+        out_.insert(out_.end(), data, data + head);
+        if (!writeOut(out_.data(), out_.size())) return false;
+        return writeRecords(data + head, length - head);
+    }
+    if (pending_.size() + total <= limit_) {
+        // Fits, but fills the record or latency comes first: write it all now.
+        pending_.insert(pending_.end(), header, header + headerLength);
+        pending_.insert(pending_.end(), data, data + length);
+        takePendingLocked();
+        lock.unlock();
+        return writeOut(out_.data(), out_.size());
+    }
+    if (frame) {
+        // A small frame that does not fit: the pending record goes first and the
+        // frame starts the next one.
+        takePendingLocked();
+        pending_.insert(pending_.end(), header, header + headerLength);
+        pending_.insert(pending_.end(), data, data + length);
+        armDeadlineLocked();
+        lock.unlock();
+        return writeOut(out_.data(), out_.size());
+    }
+
+    // Raw bytes: fill up the pending record, then write the rest without copying it.
+    size_t head = limit_ > pending_.size() ? limit_ - pending_.size() : 0;
+    takePendingLocked();
+    out_.insert(out_.end(), data, data + head);
+    lock.unlock();
+    if (!writeOut(out_.data(), out_.size())) return false;
+    return writeRecords(data + head, length - head);
+}
+
+// Writes the pending bytes; with `onlyIfDue` only once their deadline has passed.
+bool FrameCoalescer::flushPending(bool onlyIfDue) {
+    std::unique_lock<std::mutex> order(writeMutex_, std::defer_lock);
+    if (onlyIfDue) {
+        // The timer must not wait behind a slow write; that writer's caller flushes
+        // again soon, and the deadline is pushed back in case it does not.
+        if (!order.try_lock()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!pending_.empty()) Timer::instance().schedule(this, Clock::now() + delay_);
+            return true;
+        }
+    }
+    else {
+        order.lock();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (onlyIfDue && (deadline_ == Clock::time_point() || Clock::now() < deadline_)) return true;
+    if (failed_) return false;
+    takePendingLocked();
+    if (out_.empty()) return true;
+    lock.unlock();
+    return writeOut(out_.data(), out_.size());
+}
+
+// Moves pending_ into out_ (writeMutex_ held).
+void FrameCoalescer::takePendingLocked() {
+    out_.clear();
+    out_.swap(pending_);
+    deadline_ = Clock::time_point();
+}
+
+void FrameCoalescer::armDeadlineLocked() {
+    if (pending_.empty() || deadline_ != Clock::time_point()) return;
+    deadline_ = Clock::now() + delay_;
+    Timer::instance().schedule(this, deadline_);
+}
+
+void FrameCoalescer::updateLimitLocked() {
+    limit_ = smaller(sizer_.recordLimit(Clock::now()), MAX_RECORD);
+}
+
+bool FrameCoalescer::writeOut(const uint8_t* data, size_t length) {
+    bool ok = writer_(data, length);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++writes_;
+    if (!ok) {
+        failed_ = true;
+        return false;
+    }
+    Clock::time_point now = Clock::now();
+    for (size_t record = 0; record < length; record += MAX_RECORD) {
+        sizer_.recorded(smaller(MAX_RECORD, length - record), now);
+    }
+    updateLimitLocked();
+    return true;
+}
+
+// Writes `data` directly, one call per record while records are small. Large records
+// are left to the TLS layer, which splits a write into MAX_RECORD records itself.
+bool FrameCoalescer::writeRecords(const uint8_t* data, size_t length) {
+    bool large;
+    size_t limit;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        large = sizer_.large();
+        limit = limit_;
+    }
+    size_t step = large ? length : limit;
+    for (size_t offset = 0; offset < length; ) {
+        size_t size = smaller(step, length - offset);
+        if (!writeOut(data + offset, size)) return false;
+        offset += size;
+        bool wasLarge = large;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            large = sizer_.large();
+            limit = limit_;
+        }
+        if (!large) step = limit;
+        else if (!wasLarge) step = length - offset; // Grew: the rest can go out in one write.
+    }
+    return true;
+}
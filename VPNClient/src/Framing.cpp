@@ -0,0 +1,88 @@
+#include "Framing.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+bool knownType(uint8_t type) {
+    return type >= FRAME_HELLO && type <= FRAME_STREAM_CLOSE;
+}
+
+}
+
+void Framing::writeHeader(FrameType type, uint8_t flags, size_t length, uint8_t* out) {
+    out[0] = type;
+    out[1] = flags;
+    out[2] = static_cast<uint8_t>(length >> 8);
+    out[3] = static_cast<uint8_t>(length);
+}
+
+size_t Framing::encode(FrameType type, uint8_t flags, const uint8_t* payload, size_t length,
+                       uint8_t* out, size_t capacity) {
+    if (length > MAX_PAYLOAD || capacity < HEADER_SIZE + length) return 0;
+    writeHeader(type, flags, length, out);
+    if (length > 0) std::memcpy(out + HEADER_SIZE, payload, length);
+    return HEADER_SIZE + length;
+}
+
+bool Framing::append(std::vector<uint8_t>& out, FrameType type, uint8_t flags,
+                     const uint8_t* payload, size_t length) {
+    if (length > MAX_PAYLOAD) return false;
+    size_t offset = out.size();
+    out.resize(offset + HEADER_SIZE + length);
+    encode(type, flags, payload, length, out.data() + offset, HEADER_SIZE + length);
+    return true;
+}
+
+FrameParser::FrameParser(size_t maxPayload)
+    : buffer_(INITIAL_CAPACITY)
+    , begin_(0)
+    , end_(0)
+    , maxPayload_(maxPayload < Framing::MAX_PAYLOAD ? maxPayload : Framing::MAX_PAYLOAD) {
+}
+
+uint8_t* FrameParser::writeBuffer() {
+    compact();
+    return buffer_.data() + end_;
+}
+
+void FrameParser::commit(size_t length) {
+    end_ += std::min(length, buffer_.size() - end_);
+}
+
+void FrameParser::feed(const uint8_t* data, size_t length) {
+    compact();
+    if (buffer_.size() - end_ < length) buffer_.resize(end_ + length);
+    std::memcpy(buffer_.data() + end_, data, length);
+    end_ += length;
+}
+
+FrameParser::Result FrameParser::next(FrameView& frame) {
+    if (buffered() < Framing::HEADER_SIZE) return NEED_MORE;
+
+    const uint8_t* header = buffer_.data() + begin_;
+    size_t length = (static_cast<size_t>(header[2]) << 8) | header[3];
+    if (!knownType(header[0]) || length > maxPayload_) return INVALID;
+
+    size_t frameSize = Framing::HEADER_SIZE + length;
+    if (buffered() < frameSize) {
+        // Make sure the rest of a large frame fits; this only grows once per size.
+        if (buffer_.size() < frameSize) buffer_.resize(frameSize);
+        return NEED_MORE;
+    }
+
+    frame.type = static_cast<FrameType>(header[0]);
+    frame.flags = header[1];
+    frame.payload = header + Framing::HEADER_SIZE;
+    frame.length = length;
+    begin_ += frameSize;
+    return FRAME;
+}
+
+void FrameParser::compact() {
+    if (begin_ == 0) return;
+    // Only the tail of a partial frame is ever moved.
+    if (end_ > begin_) std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+}
@@ -0,0 +1,118 @@
+#include "KernelTls.h"
+#include <Poco/Net/SocketImpl.h>
+#include <openssl/crypto.h>
+#include <openssl/ssl.h>
+#include <fstream>
+#include <string>
+
+#if defined(VPN_KTLS) && defined(__linux__) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define KERNEL_TLS_SUPPORTED 1
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <cerrno>
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TLS_TX
+#define TLS_TX 1
+#endif
+#ifndef TLS_RX
+#define TLS_RX 2
+#endif
+#endif
+
+namespace {
+
+#if defined(KERNEL_TLS_SUPPORTED)
+
+// True if the kernel has crypto state for `direction` (TLS_TX or TLS_RX) on `fd`.
+// The kernel answers with the key material, so the buffer is wiped right away.
+bool directionOffloaded(int fd, int direction) {
+    unsigned char info[128];
+    socklen_t length = sizeof(info);
+    bool offloaded = getsockopt(fd, SOL_TLS, direction, info, &length) == 0;
+    OPENSSL_cleanse(info, sizeof(info));
+    return offloaded;
+}
+
+#endif
+
+}
+
+std::string KernelTls::Status::toString() const {
+    if (send && receive) return "send+receive";
+    if (send) return "send";
+    if (receive) return "receive";
+    return "off";
+}
+
+bool KernelTls::available() {
+#if defined(KERNEL_TLS_SUPPORTED)
+    struct stat module;
+    if (stat("/sys/module/tls", &module) == 0) return true;
+
+    std::ifstream ulps("/proc/sys/net/ipv4/tcp_available_ulp");
+    std::string name;
+    while (ulps >> name) {
+        if (name == "tls") return true;
+    }
+    return false;
+#else
+    return false;
+#endif
+}
+
+bool KernelTls::enable(Poco::Net::Context& context) {
+#if defined(KERNEL_TLS_SUPPORTED)
+    if (!available()) return false;
+    SSL_CTX_set_options(context.sslContext(), SSL_OP_ENABLE_KTLS);
+    return true;
+#else
+    (void)context;
+    return false;
+#endif
+}
+
+KernelTls::Status KernelTls::status(const Poco::Net::Socket& socket) {
+    Status status;
+#if defined(KERNEL_TLS_SUPPORTED)
+    int fd = socket.impl()->sockfd();
+    char ulp[16] = {0};
+    socklen_t length = sizeof(ulp) - 1;
+    if (getsockopt(fd, IPPROTO_TCP, TCP_ULP, ulp, &length) != 0 || std::string(ulp) != "tls") {
+        return status;
+    }
+    status.send = directionOffloaded(fd, TLS_TX);
+    status.receive = directionOffloaded(fd, TLS_RX);
+#else
+    (void)socket;
+#endif
+    return status;
+}
+
+long KernelTls::sendFile(const Poco::Net::Socket& socket, int fd, int64_t offset, size_t length) {
+#if defined(KERNEL_TLS_SUPPORTED)
+    int sockfd = socket.impl()->sockfd();
+    off_t position = static_cast<off_t>(offset);
+    size_t total = 0;
+    while (total < length) {
+        ssize_t sent = ::sendfile(sockfd, fd, &position, length - total);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return total > 0 ? static_cast<long>(total) : -1;
+        total += static_cast<size_t>(sent);
+    }
+    return static_cast<long>(total);
+#else
+    (void)socket;
+    (void)fd;
+    (void)offset;
+    (void)length;
+    return -1;
+#endif
+}
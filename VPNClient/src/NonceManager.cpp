@@ -0,0 +1,33 @@
+#include "NonceManager.h"
+#include <cstring>
+
+NonceManager::NonceManager(const uint8_t* salt) : counter_(0) {
+    std::memcpy(salt_, salt, SALT_SIZE);
+}
+
+bool NonceManager::next(uint8_t* nonce, uint64_t& counter) {
+    if (counter_ == UINT64_MAX) return false;
+
+    counter = counter_++;
+    nonceFor(counter, nonce);
+    return true;
+}
+
+void NonceManager::nonceFor(uint64_t counter, uint8_t* nonce) const {
+    std::memcpy(nonce, salt_, SALT_SIZE);
+    writeCounter(counter, nonce + SALT_SIZE);
+}
+
+void NonceManager::writeCounter(uint64_t counter, uint8_t* out) {
+    for (size_t i = 0; i < EXPLICIT_SIZE; ++i) {
+        out[i] = static_cast<uint8_t>(counter >> (8 * (EXPLICIT_SIZE - 1 - i)));
+    }
+}
+
+uint64_t NonceManager::readCounter(const uint8_t* in) {
+    uint64_t counter = 0;
+    for (size_t i = 0; i < EXPLICIT_SIZE; ++i) {
+        counter = (counter << 8) | in[i];
+    }
+    return counter;
+}
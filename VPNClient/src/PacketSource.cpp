@@ -0,0 +1,224 @@
+#include "PacketSource.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+const size_t IPV4_HEADER_SIZE = 20;
+const size_t IPV6_HEADER_SIZE = 40;
+const uint8_t PROTOCOL_TCP = 6;
+const uint8_t PROTOCOL_UDP = 17;
+
+const uint32_t FNV_OFFSET = 2166136261u;
+const uint32_t FNV_PRIME = 16777619u;
+
+uint32_t fnv(uint32_t hash, const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Raw bytes of the source or destination address, for either IP version.
+bool address(const uint8_t* packet, size_t length, bool source, std::string& result) {
+    if (length < 1) return false;
+    switch (packet[0] >> 4) {
+    case 4:
+        if (length < IPV4_HEADER_SIZE) return false;
+        result.assign(reinterpret_cast<const char*>(packet + (source ? 12 : 16)), 4);
+        return true;
+    case 6:
+        if (length < IPV6_HEADER_SIZE) return false;
+        result.assign(reinterpret_cast<const char*>(packet + (source ? 8 : 24)), 16);
+        return true;
+    default:
+        return false;
+    }
+}
+
+}
+
+PacketBatch::PacketBatch(size_t capacity, size_t slotSize)
+    : storage_((capacity > 0 ? capacity : 1) * slotSize)
+    , lengths_(capacity > 0 ? capacity : 1)
+    , slotSize_(slotSize)
+    , count_(0) {}
+
+MemoryPacketSource::MemoryPacketSource(bool keepWritten, size_t maxQueued)
+    : keepWritten_(keepWritten)
+    , maxQueued_(maxQueued > 0 ? maxQueued : 1)
+    , writtenPackets_(0)
+    , writtenBytes_(0)
+    , closed_(false) {}
+
+bool MemoryPacketSource::inject(const uint8_t* packet, size_t length) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    writable_.wait(lock, [this] { return closed_ || inbound_.size() < maxQueued_; });
+    if (closed_) return false;
+    bool wasEmpty = inbound_.empty();
+    inbound_.emplace_back(packet, packet + length);
+    if (wasEmpty) readable_.notify_one();
+    return true;
+}
+
+int MemoryPacketSource::readBatch(PacketBatch& batch, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!readable_.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                            [this] { return closed_ || !inbound_.empty(); })) {
+        return 0;
+    }
+    if (closed_) return -1;
+
+    // Everything queued, up to a full batch, under one lock.
+    int count = 0;
+    while (!inbound_.empty() && !batch.full()) {
+        const std::vector<uint8_t>& packet = inbound_.front();
+        size_t length = packet.size() < batch.slotSize() ? packet.size() : batch.slotSize();
+        std::memcpy(batch.nextSlot(), packet.data(), length);
+        batch.commit(length);
+        inbound_.pop_front();
+        ++count;
+    }
+    writable_.notify_all();
+    return count;
+}
+
+bool MemoryPacketSource::write(const uint8_t* packet, size_t length) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) return false;
+        if (keepWritten_) outbound_.emplace_back(packet, packet + length);
+        writtenBytes_ += length;
+        ++writtenPackets_;
+    }
+    written_.notify_all();
+    return true;
+}
+
+std::vector<std::vector<uint8_t>> MemoryPacketSource::take() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::vector<uint8_t>> packets;
+    packets.swap(outbound_);
+    return packets;
+}
+
+bool MemoryPacketSource::waitWritten(uint64_t packets, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return written_.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                             [this, packets] { return writtenPackets_ >= packets; });
+}
+
+void MemoryPacketSource::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    readable_.notify_all();
+    writable_.notify_all();
+    written_.notify_all();
+}
+
+PacketQueues::PacketQueues(std::vector<std::shared_ptr<PacketSource>> queues)
+    : queues_(std::move(queues)) {}
+
+PacketSource& PacketQueues::queueFor(const uint8_t* packet, size_t length) {
+    return *queues_[IpPacket::flowHash(packet, length) % queues_.size()];
+}
+
+bool PacketQueues::write(const uint8_t* packet, size_t length) {
+    return queueFor(packet, length).write(packet, length);
+}
+
+void PacketQueues::close() {
+    for (auto& queue : queues_) queue->close();
+}
+
+std::string PacketQueues::name() const {
+    if (queues_.empty()) return "none";
+    if (queues_.size() == 1) return queues_.front()->name();
+    return queues_.front()->name() + " (" + std::to_string(queues_.size()) + " queues)";
+}
+
+bool PacketQueues::pinToCore(size_t index) {
+#if defined(__linux__)
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores == 0) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cores, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)index;
+    return false;
+#endif
+}
+
+bool IpPacket::sourceAddress(const uint8_t* packet, size_t length, std::string& result) {
+    return address(packet, length, true, result);
+}
+
+bool IpPacket::destinationAddress(const uint8_t* packet, size_t length, std::string& result) {
+    return address(packet, length, false, result);
+}
+
+uint32_t IpPacket::flowHash(const uint8_t* packet, size_t length) {
+    if (length < 1) return 0;
+    const uint8_t* source = nullptr;
+    const uint8_t* destination = nullptr;
+    size_t addressSize = 0;
+    uint8_t protocol = 0;
+    size_t ports = 0;    // Offset of the TCP/UDP ports, 0 if there are none to use.
+    switch (packet[0] >> 4) {
+    case 4: {
+        if (length < IPV4_HEADER_SIZE) return 0;
+        source = packet + 12;
+        destination = packet + 16;
+        addressSize = 4;
+        protocol = packet[9];
+        // Fragments (MF or an offset) all hash without ports: only the first one has them.
+        bool fragment = (packet[6] & 0x3f) != 0 || packet[7] != 0;
+        if (!fragment) ports = (packet[0] & 0x0f) * 4;
+        break;
+    }
+    case 6:
+        if (length < IPV6_HEADER_SIZE) return 0;
+        source = packet + 8;
+        destination = packet + 24;
+        addressSize = 16;
+        protocol = packet[6];    // Ports only without extension headers.
+        ports = IPV6_HEADER_SIZE;
+        break;
+    default:
+        return 0;
+    }
+    bool withPorts = (protocol == PROTOCOL_TCP || protocol == PROTOCOL_UDP) && ports != 0 && length >= ports + 4;
+
+    // One hash per endpoint, combined in a fixed order so A->B and B->A match.
+    uint32_t from = fnv(FNV_OFFSET, source, addressSize);
+    uint32_t to = fnv(FNV_OFFSET, destination, addressSize);
+    if (withPorts) {
+        from = fnv(from, packet + ports, 2);
+        to = fnv(to, packet + ports + 2, 2);
+    }
+    uint32_t low = std::min(from, to);
+    uint32_t high = std::max(from, to);
+    uint32_t hash = fnv(FNV_OFFSET, &protocol, 1);
+    hash = fnv(hash, reinterpret_cast<const uint8_t*>(&low), sizeof(low));
+    return fnv(hash, reinterpret_cast<const uint8_t*>(&high), sizeof(high));
+}
+
+std::string IpPacket::toString(const std::string& address) {
+    char text[INET6_ADDRSTRLEN] = "";
+    int family = address.size() == 4 ? AF_INET : AF_INET6;
+    if (address.size() != 4 && address.size() != 16) return "?";
+    if (!inet_ntop(family, address.data(), text, sizeof(text))) return "?";
+    return text;
+}
@@ -0,0 +1,269 @@
+#include "RekeyingCipher.h"
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+const char HKDF_LABEL[] = "vpn epoch key";
+const size_t DERIVED_SIZE = AeadCipher::KEY_SIZE + 2 * AeadCipher::SALT_SIZE;
+
+bool hkdf(const uint8_t* secret, size_t secretLength, const uint8_t* info, size_t infoLength,
+          uint8_t* out, size_t outLength) {
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+    bool ok = ctx
+        && EVP_PKEY_derive_init(ctx) > 0
+        && EVP_PKEY_CTX_set_hkdf_md(ctx, EVP_sha256()) > 0
+        && EVP_PKEY_CTX_set1_hkdf_key(ctx, secret, static_cast<int>(secretLength)) > 0
+        && EVP_PKEY_CTX_add1_hkdf_info(ctx, info, static_cast<int>(infoLength)) > 0
+        && EVP_PKEY_derive(ctx, out, &outLength) > 0;
+    EVP_PKEY_CTX_free(ctx);
+    return ok;
+}
+
+}
+
+// Derives the next epoch key of queued sessions, one at a time, on a single thread.
+// A session is queued at most once; cancel() takes it off the queue and waits if its
+// key is being derived right now, so a destroyed session is never touched.
+class RekeyingCipher::Deriver {
+public:
+    static Deriver& instance() {
+        // Never destroyed: sessions held by other static objects may outlive it.
+        static Deriver* deriver = new Deriver();
+        return *deriver;
+    }
+
+    void schedule(RekeyingCipher* session) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (std::find(queue_.begin(), queue_.end(), session) != queue_.end()) return;
+            queue_.push_back(session);
+        }
+        wake_.notify_one();
+    }
+
+    void cancel(RekeyingCipher* session) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        queue_.erase(std::remove(queue_.begin(), queue_.end(), session), queue_.end());
+        done_.wait(lock, [this, session] { return running_ != session; });
+    }
+
+private:
+    Deriver()
+        : running_(nullptr)
+        , thread_(&Deriver::run, this) {}
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait(lock, [this] { return !queue_.empty(); });
+            RekeyingCipher* session = queue_.front();
+            queue_.pop_front();
+            running_ = session;
+            lock.unlock();
+            session->deriveNext();
+            lock.lock();
+            running_ = nullptr;
+            done_.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;    // Sessions were queued.
+    std::condition_variable done_;    // running_ finished.
+    std::deque<RekeyingCipher*> queue_;
+    RekeyingCipher* running_;
+    std::thread thread_;
+};
+
+RekeyingCipher::RekeyingCipher(AeadCipher::Algorithm algorithm, const uint8_t* secret, size_t secretLength,
+                               Role role, const Policy& policy)
+    : algorithm_(algorithm)
+    , role_(role)
+    , policy_(policy)
+    , secretLength_(secretLength)
+    , peerUsedCurrent_(false)
+    , peerUsedPrevious_(false)
+    , rekeyRequested_(false)
+    , bytesSent_(0)
+    , epochStart_(std::chrono::steady_clock::now()) {
+    if (secretLength == 0 || secretLength > sizeof(secret_)) {
+        throw std::runtime_error("Rekeying session: invalid secret length");
+    }
+    std::memcpy(secret_, secret, secretLength);
+
+    current_.number = 0;
+    current_.cipher = derive(0);
+    if (!current_.cipher) {
+        throw std::runtime_error("Rekeying session: key derivation failed");
+    }
+    previous_.number = 0;
+    next_.number = 1;
+    ahead_.number = 0;
+    Deriver::instance().schedule(this);
+}
+
+RekeyingCipher::~RekeyingCipher() {
+    Deriver::instance().cancel(this);
+    OPENSSL_cleanse(secret_, sizeof(secret_));
+}
+
+std::shared_ptr<AeadCipher> RekeyingCipher::derive(uint32_t epoch) const {
+    uint8_t info[sizeof(HKDF_LABEL) + 4];
+    std::memcpy(info, HKDF_LABEL, sizeof(HKDF_LABEL));
+    for (int i = 0; i < 4; ++i) {
+        info[sizeof(HKDF_LABEL) + i] = static_cast<uint8_t>(epoch >> (24 - 8 * i));
+    }
+
+    uint8_t derived[DERIVED_SIZE];
+    if (!hkdf(secret_, secretLength_, info, sizeof(info), derived, sizeof(derived))) return nullptr;
+
+    const uint8_t* key = derived;
+    const uint8_t* clientSalt = derived + AeadCipher::KEY_SIZE;
+    const uint8_t* serverSalt = clientSalt + AeadCipher::SALT_SIZE;
+    std::shared_ptr<AeadCipher> cipher;
+    try {
+        cipher = role_ == CLIENT
+            ? std::make_shared<AeadCipher>(algorithm_, key, clientSalt, serverSalt)
+            : std::make_shared<AeadCipher>(algorithm_, key, serverSalt, clientSalt);
+    }
+    catch (const std::exception&) {
+    }
+    OPENSSL_cleanse(derived, sizeof(derived));
+    return cipher;
+}
+
+void RekeyingCipher::deriveNext() {
+    uint32_t epochs[2];
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!next_.cipher) epochs[count++] = next_.number;
+        if (ahead_.number != 0 && !ahead_.cipher) epochs[count++] = ahead_.number;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        // Derive outside the lock so the data path never waits for HKDF or key setup.
+        std::shared_ptr<AeadCipher> cipher = derive(epochs[i]);
+        if (!cipher) continue;
+        std::lock_guard<std::mutex> lock(mutex_);
+        Epoch* slot = next_.number == epochs[i] ? &next_ : ahead_.number == epochs[i] ? &ahead_ : nullptr;
+        if (slot && !slot->cipher) {
+            slot->cipher = cipher;
+        }
+    }
+}
+
+void RekeyingCipher::promoteLocked(Epoch target) {
+    // The previous key stays for the peer's packets still in flight. A peer that has not
+    // used the current key yet is still on the previous one, so that one stays instead.
+    if (peerUsedCurrent_ || !peerUsedPrevious_) {
+        previous_ = current_;
+        peerUsedPrevious_ = peerUsedCurrent_;
+    }
+    current_ = target;
+    next_.number = current_.number + 1;
+    next_.cipher.reset();
+    ahead_.number = 0;
+    ahead_.cipher.reset();
+    peerUsedCurrent_ = false;
+    rekeyRequested_ = false;
+    bytesSent_ = 0;
+    epochStart_ = std::chrono::steady_clock::now();
+    Deriver::instance().schedule(this);
+}
+
+size_t RekeyingCipher::encrypt(uint8_t* buffer, size_t capacity, size_t payloadLength) {
+    if (capacity < EPOCH_SIZE) return 0;
+
+    std::shared_ptr<AeadCipher> cipher;
+    uint32_t epoch;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool due = rekeyRequested_ || bytesSent_ >= policy_.maxBytes
+            || current_.cipher->packetsSent() >= UINT64_MAX / 2
+            || std::chrono::steady_clock::now() - epochStart_ >= policy_.maxAge;
+        // Switch on our own budget, even if the peer never answers; the next key only has
+        // to be ready, otherwise keep going and try again on a later packet.
+        if (due && next_.cipher) {
+            promoteLocked(next_);
+        }
+        else if (due && !next_.cipher) {
+            Deriver::instance().schedule(this);    // A failed derivation is retried.
+        }
+        bytesSent_ += payloadLength;
+        cipher = current_.cipher;
+        epoch = current_.number;
+    }
+
+    buffer[0] = static_cast<uint8_t>(epoch);
+    size_t sealedLength = cipher->encrypt(buffer + EPOCH_SIZE, capacity - EPOCH_SIZE, payloadLength);
+    return sealedLength == 0 ? 0 : sealedLength + EPOCH_SIZE;
+}
+
+bool RekeyingCipher::decrypt(uint8_t* buffer, size_t sealedLength, size_t& payloadLength, uint64_t* sequence) {
+    if (sealedLength < OVERHEAD) return false;
+
+    uint8_t epochByte = buffer[0];
+    std::shared_ptr<AeadCipher> cipher;
+    uint32_t epoch = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Epoch* candidates[] = {&current_, &previous_, &next_, &ahead_};
+        for (const Epoch* candidate : candidates) {
+            if (candidate->cipher && static_cast<uint8_t>(candidate->number) == epochByte) {
+                cipher = candidate->cipher;
+                epoch = candidate->number;
+                break;
+            }
+        }
+        if (!cipher && !next_.cipher && static_cast<uint8_t>(next_.number) == epochByte) {
+            // The peer switched before the deriver got to the next key (back-to-back
+            // rekeys). Drop the packet rather than run HKDF on the data path; the
+            // peer's packets decrypt again once the deriver is done.
+            Deriver::instance().schedule(this);
+        }
+        uint8_t gap = static_cast<uint8_t>(epochByte - static_cast<uint8_t>(current_.number));
+        if (!cipher && gap >= 2 && gap <= MAX_EPOCH_GAP && ahead_.number != current_.number + gap) {
+            // The peer moved on while every packet of the epochs between was lost. Have
+            // that key derived too; nothing switches until a packet authenticates with it.
+            ahead_.number = current_.number + gap;
+            ahead_.cipher.reset();
+            Deriver::instance().schedule(this);
+        }
+    }
+    if (!cipher) return false;
+    if (!cipher->decrypt(buffer + EPOCH_SIZE, sealedLength - EPOCH_SIZE, payloadLength, sequence)) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (epoch == next_.number && next_.cipher) {
+        promoteLocked(next_); // The peer already switched; follow it.
+    }
+    else if (ahead_.number != 0 && epoch == ahead_.number && ahead_.cipher) {
+        promoteLocked(ahead_); // Catch up over the epochs that were lost.
+    }
+    if (epoch == current_.number) {
+        peerUsedCurrent_ = true;
+    }
+    else if (epoch == previous_.number) {
+        peerUsedPrevious_ = true;
+    }
+    return true;
+}
+
+void RekeyingCipher::requestRekey() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rekeyRequested_ = true;
+}
+
+uint32_t RekeyingCipher::sendEpoch() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_.number;
+}
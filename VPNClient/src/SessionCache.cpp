@@ -0,0 +1,89 @@
+#include "SessionCache.h"
+
+SessionCache& SessionCache::instance() {
+    static SessionCache cache;
+    return cache;
+}
+
+SessionCache::SessionCache() : resumed_(0), full_(0) {
+}
+
+std::string SessionCache::endpoint(const std::string& host, int port) {
+    return host + ":" + std::to_string(port);
+}
+
+Poco::Net::Session::Ptr SessionCache::get(const std::string& endpoint) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = sessions_.find(endpoint);
+    if (found != sessions_.end()) return found->second;
+    if (!store_) return Poco::Net::Session::Ptr();
+
+    // First connection of this process: the ticket saved by the previous run, if still valid.
+    Poco::Net::Session::Ptr session = store_->loadSession(endpoint);
+    if (session) sessions_[endpoint] = session;
+    return session;
+}
+
+void SessionCache::put(const std::string& endpoint, Poco::Net::Session::Ptr session) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!session || !session->isResumable()) {
+        sessions_.erase(endpoint);
+        if (store_) store_->saveSession(endpoint, Poco::Net::Session::Ptr());
+        return;
+    }
+    if (sessions_.size() >= MAX_ENTRIES && sessions_.find(endpoint) == sessions_.end()) {
+        sessions_.erase(sessions_.begin());    // Any endpoint will do; it just does a full handshake.
+    }
+    sessions_[endpoint] = session;
+    if (store_) store_->saveSession(endpoint, session);
+}
+
+void SessionCache::remove(const std::string& endpoint) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sessions_.erase(endpoint);
+    addresses_.erase(endpoint);
+    if (store_) store_->remove(endpoint);
+}
+
+void SessionCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sessions_.clear();
+    addresses_.clear();
+}
+
+size_t SessionCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sessions_.size();
+}
+
+Poco::Net::SocketAddress SessionCache::resolve(const std::string& host, int port, bool fresh) {
+    std::string key = endpoint(host, port);
+    if (!fresh) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = addresses_.find(key);
+        if (found != addresses_.end()) return Poco::Net::SocketAddress(found->second);
+        if (store_) {
+            std::string address = store_->loadAddress(key);
+            if (!address.empty()) {
+                addresses_[key] = address;
+                return Poco::Net::SocketAddress(address);
+            }
+        }
+    }
+
+    // DNS lookup outside the lock.
+    Poco::Net::SocketAddress address(host, static_cast<uint16_t>(port));
+    std::lock_guard<std::mutex> lock(mutex_);
+    addresses_[key] = address.toString();
+    if (store_) store_->saveAddress(key, address.toString());
+    return address;
+}
+
+void SessionCache::setStore(std::shared_ptr<SessionStore> store) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    store_ = std::move(store);
+}
+
+void SessionCache::recordHandshake(bool resumed) {
+    ++(resumed ? resumed_ : full_);
+}
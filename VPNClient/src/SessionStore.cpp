@@ -0,0 +1,214 @@
+#include "SessionStore.h"
+#include <openssl/ssl.h>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char MAGIC[8] = {'V', 'P', 'N', 'S', 'T', 'O', 'R', 'E'};
+const uint32_t VERSION = 1;
+
+// Copies `value` into a fixed, NUL-terminated field. Returns false if it does not fit.
+bool copyField(char* field, size_t capacity, const std::string& value) {
+    if (value.size() >= capacity) return false;
+    std::memset(field, 0, capacity);
+    std::memcpy(field, value.data(), value.size());
+    return true;
+}
+
+}
+
+struct SessionStore::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slots;
+};
+
+struct SessionStore::Slot {
+    char endpoint[ENDPOINT_CAPACITY];
+    char address[ADDRESS_CAPACITY];
+    int64_t savedAt;           // Unix time of the last save; 0 marks a free slot.
+    uint32_t ticketLength;
+    uint8_t ticket[TICKET_CAPACITY];
+    uint64_t checksum;         // FNV-1a over everything above.
+};
+
+SessionStore::SessionStore(const std::string& path)
+    : path_(path)
+    , fd_(-1)
+    , map_(nullptr)
+    , size_(sizeof(Header) + SLOTS * sizeof(Slot)) {
+#if defined(_WIN32)
+    throw std::runtime_error("Session store: not supported on this platform");
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd_ < 0) throw std::runtime_error("Session store: cannot open " + path);
+
+    struct stat info;
+    bool fresh = ::fstat(fd_, &info) != 0 || static_cast<size_t>(info.st_size) != size_;
+    if (fresh && ::ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+        ::close(fd_);
+        throw std::runtime_error("Session store: cannot size " + path);
+    }
+    void* map = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        ::close(fd_);
+        throw std::runtime_error("Session store: cannot map " + path);
+    }
+    map_ = static_cast<uint8_t*>(map);
+
+    Header* header = reinterpret_cast<Header*>(map_);
+    if (fresh || std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0
+        || header->version != VERSION || header->slots != SLOTS) {
+        std::memset(map_, 0, size_);
+        std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+        header->version = VERSION;
+        header->slots = SLOTS;
+    }
+#endif
+}
+
+SessionStore::~SessionStore() {
+#if !defined(_WIN32)
+    if (map_) {
+        ::msync(map_, size_, MS_ASYNC);
+        ::munmap(map_, size_);
+    }
+    if (fd_ >= 0) ::close(fd_);
+#endif
+}
+
+std::string SessionStore::defaultPath() {
+    const char* path = std::getenv("VPN_SESSION_STORE");
+    if (path && *path) return path;
+    const char* home = std::getenv("HOME");
+    return std::string(home && *home ? home : ".") + "/.vpn_client_sessions";
+}
+
+Poco::Net::Session::Ptr SessionStore::loadSession(const std::string& endpoint) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Slot* slot = findLocked(endpoint);
+    if (!slot || slot->ticketLength == 0) return Poco::Net::Session::Ptr();
+
+    const unsigned char* der = slot->ticket;
+    SSL_SESSION* session = d2i_SSL_SESSION(nullptr, &der, static_cast<long>(slot->ticketLength));
+    if (!session) return Poco::Net::Session::Ptr();
+
+    // The server would refuse an expired ticket anyway; offering it only costs bytes.
+    long expires = static_cast<long>(SSL_SESSION_get_time(session)) + SSL_SESSION_get_timeout(session);
+    if (expires <= static_cast<long>(std::time(nullptr)) || !SSL_SESSION_is_resumable(session)) {
+        SSL_SESSION_free(session);
+        return Poco::Net::Session::Ptr();
+    }
+    return new Poco::Net::Session(session);    // Takes ownership.
+}
+
+bool SessionStore::saveSession(const std::string& endpoint, Poco::Net::Session::Ptr session) {
+    int length = session && session->sslSession() ? i2d_SSL_SESSION(session->sslSession(), nullptr) : 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (length <= 0 || static_cast<size_t>(length) > TICKET_CAPACITY) {
+        // Nothing resumable: forget the old ticket but keep the address.
+        Slot* slot = findLocked(endpoint);
+        if (slot && slot->ticketLength != 0) {
+            std::memset(slot->ticket, 0, TICKET_CAPACITY);
+            slot->ticketLength = 0;
+            sealLocked(*slot);
+        }
+        return false;
+    }
+    Slot* slot = claimLocked(endpoint);
+    if (!slot) return false;
+    unsigned char* der = slot->ticket;
+    i2d_SSL_SESSION(session->sslSession(), &der);
+    slot->ticketLength = static_cast<uint32_t>(length);
+    sealLocked(*slot);
+    return true;
+}
+
+std::string SessionStore::loadAddress(const std::string& endpoint) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Slot* slot = findLocked(endpoint);
+    return slot ? std::string(slot->address) : std::string();
+}
+
+bool SessionStore::saveAddress(const std::string& endpoint, const std::string& address) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Slot* slot = claimLocked(endpoint);
+    if (!slot || !copyField(slot->address, ADDRESS_CAPACITY, address)) return false;
+    sealLocked(*slot);
+    return true;
+}
+
+void SessionStore::remove(const std::string& endpoint) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Slot* slot = findLocked(endpoint);
+    if (!slot) return;
+    std::memset(slot, 0, sizeof(Slot));
+    sealLocked(*slot);
+}
+
+SessionStore::Slot* SessionStore::slots() {
+    return reinterpret_cast<Slot*>(map_ + sizeof(Header));
+}
+
+SessionStore::Slot* SessionStore::findLocked(const std::string& endpoint) {
+    if (!map_) return nullptr;
+    for (size_t i = 0; i < SLOTS; ++i) {
+        Slot& slot = slots()[i];
+        if (slot.savedAt != 0 && valid(slot) && endpoint == slot.endpoint) return &slot;
+    }
+    return nullptr;
+}
+
+// The endpoint's slot, else a free or corrupt one, else the least recently saved.
+SessionStore::Slot* SessionStore::claimLocked(const std::string& endpoint) {
+    if (!map_ || endpoint.size() >= ENDPOINT_CAPACITY) return nullptr;
+    Slot* slot = findLocked(endpoint);
+    if (slot) return slot;
+
+    Slot* oldest = &slots()[0];
+    for (size_t i = 0; i < SLOTS; ++i) {
+        Slot& candidate = slots()[i];
+        if (candidate.savedAt == 0 || !valid(candidate)) {
+            oldest = &candidate;
+            break;
+        }
+        if (candidate.savedAt < oldest->savedAt) oldest = &candidate;
+    }
+    std::memset(oldest, 0, sizeof(Slot));
+    copyField(oldest->endpoint, ENDPOINT_CAPACITY, endpoint);
+    return oldest;
+}
+
+void SessionStore::sealLocked(Slot& slot) {
+    if (slot.endpoint[0] != '\0') slot.savedAt = static_cast<int64_t>(std::time(nullptr));
+    slot.checksum = checksum(slot);
+#if !defined(_WIN32)
+    ::msync(map_, size_, MS_ASYNC);
+#endif
+}
+
+uint64_t SessionStore::checksum(const Slot& slot) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&slot);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < offsetof(Slot, checksum); ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool SessionStore::valid(const Slot& slot) {
+    return slot.checksum == checksum(slot) && slot.ticketLength <= TICKET_CAPACITY
+        && std::memchr(slot.endpoint, '\0', ENDPOINT_CAPACITY) && std::memchr(slot.address, '\0', ADDRESS_CAPACITY);
+}
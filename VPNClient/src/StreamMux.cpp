@@ -0,0 +1,276 @@
+#include "StreamMux.h"
+#include <cstring>
+
+namespace {
+
+void writeId(uint32_t value, uint8_t* out) {
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+uint32_t readId(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16)
+         | (static_cast<uint32_t>(in[2]) << 8) | static_cast<uint32_t>(in[3]);
+}
+
+size_t smallest(size_t a, size_t b, size_t c) {
+    size_t result = a < b ? a : b;
+    return result < c ? result : c;
+}
+
+}
+
+StreamMux::StreamMux(Role role, Writer writer)
+    : role_(role)
+    , writer_(std::move(writer))
+    , nextId_(role == CLIENT ? 1 : 2)
+    , highestPeerId_(0)
+    , shutdown_(false) {
+}
+
+bool StreamMux::isStreamFrame(FrameType type) {
+    return type >= FRAME_STREAM_OPEN && type <= FRAME_STREAM_CLOSE;
+}
+
+void StreamMux::setHandler(Handler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    handler_ = std::move(handler);
+}
+
+uint32_t StreamMux::open() {
+    uint32_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shutdown_ || streams_.size() >= MAX_STREAMS || nextId_ > 0xFFFFFFFDu) return 0;
+        id = nextId_;
+        nextId_ += 2;
+        streams_[id] = std::make_shared<Stream>();
+    }
+    if (!sendControl(FRAME_STREAM_OPEN, 0, id, nullptr)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        streams_.erase(id);
+        return 0;
+    }
+    return id;
+}
+
+uint32_t StreamMux::accept(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!changed_.wait_for(lock, timeout, [this]() { return shutdown_ || !accepted_.empty(); }) || shutdown_) {
+        return 0;
+    }
+    uint32_t id = accepted_.front();
+    accepted_.pop_front();
+    return id;
+}
+
+bool StreamMux::write(uint32_t id, const uint8_t* data, size_t length, std::chrono::milliseconds timeout) {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    std::vector<uint8_t> payload;
+    size_t offset = 0;
+    while (offset < length) {
+        size_t chunk = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            StreamPtr stream = findLocked(id);
+            if (!stream) return false;
+            bool ready = changed_.wait_until(lock, deadline, [this, &stream]() {
+                return shutdown_ || stream->reset || stream->localClosed || stream->sendCredit > 0;
+            });
+            if (!ready || shutdown_ || stream->reset || stream->localClosed) return false;
+            chunk = smallest(length - offset, stream->sendCredit, MAX_CHUNK);
+            stream->sendCredit -= static_cast<uint32_t>(chunk);
+        }
+
+        payload.resize(ID_SIZE + chunk);
+        writeId(id, payload.data());
+        std::memcpy(payload.data() + ID_SIZE, data + offset, chunk);
+        if (!writer_(FRAME_STREAM_DATA, 0, payload.data(), payload.size())) return false;
+        offset += chunk;
+    }
+    return true;
+}
+
+int StreamMux::read(uint32_t id, uint8_t* buffer, size_t capacity, std::chrono::milliseconds timeout) {
+    uint32_t credit = 0;
+    size_t copied = 0;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        StreamPtr stream = findLocked(id);
+        if (!stream) return -1;
+        bool ready = changed_.wait_for(lock, timeout, [this, &stream]() {
+            return shutdown_ || stream->reset || stream->queued > 0 || stream->remoteClosed;
+        });
+        if (!ready || stream->reset || (shutdown_ && stream->queued == 0)) return -1;
+        if (stream->queued == 0) {    // Peer closed and everything was read.
+            eraseIfDoneLocked(id, *stream);
+            return 0;
+        }
+
+        while (copied < capacity && !stream->queue.empty()) {
+            std::vector<uint8_t>& front = stream->queue.front();
+            size_t take = front.size() - stream->queueOffset;
+            if (take > capacity - copied) take = capacity - copied;
+            std::memcpy(buffer + copied, front.data() + stream->queueOffset, take);
+            copied += take;
+            stream->queueOffset += take;
+            if (stream->queueOffset == front.size()) {
+                stream->queue.pop_front();
+                stream->queueOffset = 0;
+            }
+        }
+        stream->queued -= copied;
+        credit = consumedLocked(*stream, copied);
+    }
+    if (credit > 0) sendControl(FRAME_STREAM_CREDIT, 0, id, &credit);
+    return static_cast<int>(copied);
+}
+
+void StreamMux::close(uint32_t id, bool reset) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        StreamPtr stream = findLocked(id);
+        if (!stream || stream->localClosed) return;
+        if (reset) {
+            stream->reset = true;
+            streams_.erase(id);
+        }
+        else {
+            stream->localClosed = true;
+            eraseIfDoneLocked(id, *stream);
+        }
+        changed_.notify_all();
+    }
+    sendControl(FRAME_STREAM_CLOSE, reset ? STREAM_RESET : 0, id, nullptr);
+}
+
+bool StreamMux::handleFrame(const FrameView& frame) {
+    if (frame.length < ID_SIZE) return false;
+    uint32_t id = readId(frame.payload);
+    const uint8_t* body = frame.payload + ID_SIZE;
+    size_t bodyLength = frame.length - ID_SIZE;
+
+    Handler handler;
+    uint32_t credit = 0;
+    bool endOfStream = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (frame.type == FRAME_STREAM_OPEN) {
+            if (!peerId(id) || id <= highestPeerId_ || streams_.size() >= MAX_STREAMS) return false;
+            highestPeerId_ = id;
+            streams_[id] = std::make_shared<Stream>();
+            if (!handler_) {
+                accepted_.push_back(id);
+                changed_.notify_all();
+            }
+            return true;
+        }
+
+        StreamPtr stream = findLocked(id);
+        if (!stream) {
+            // Frames still in flight for a stream we closed or reset are dropped; ids that
+            // were never opened are a protocol error.
+            return peerId(id) ? id <= highestPeerId_ : (id != 0 && id < nextId_);
+        }
+
+        switch (frame.type) {
+        case FRAME_STREAM_DATA:
+            if (bodyLength > stream->receiveCredit || stream->remoteClosed) return false;
+            stream->receiveCredit -= static_cast<uint32_t>(bodyLength);
+            if (stream->reset || bodyLength == 0) return true;
+            if (handler_) {
+                handler = handler_;
+                credit = consumedLocked(*stream, bodyLength);
+                break;
+            }
+            stream->queue.push_back(std::vector<uint8_t>(body, body + bodyLength));
+            stream->queued += bodyLength;
+            changed_.notify_all();
+            return true;
+
+        case FRAME_STREAM_CREDIT:
+            if (bodyLength != 4) return false;
+            credit = readId(body);
+            if (credit > INITIAL_WINDOW - stream->sendCredit) return false;    // More than was ever sent.
+            stream->sendCredit += credit;
+            changed_.notify_all();
+            return true;
+
+        case FRAME_STREAM_CLOSE:
+            if (frame.flags & STREAM_RESET) {
+                stream->reset = true;
+                stream->queue.clear();
+                stream->queued = 0;
+                streams_.erase(id);
+            }
+            else {
+                stream->remoteClosed = true;
+            }
+            changed_.notify_all();
+            if (!handler_) {
+                if (!stream->reset) eraseIfDoneLocked(id, *stream);
+                return true;
+            }
+            handler = handler_;
+            endOfStream = true;
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    if (endOfStream) {
+        handler(id, nullptr, 0);
+        close(id);    // Handler streams end both directions together.
+        return true;
+    }
+    handler(id, body, bodyLength);
+    if (credit > 0) sendControl(FRAME_STREAM_CREDIT, 0, id, &credit);
+    return true;
+}
+
+void StreamMux::shutdown() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+    changed_.notify_all();
+}
+
+size_t StreamMux::streams() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return streams_.size();
+}
+
+StreamMux::StreamPtr StreamMux::findLocked(uint32_t id) const {
+    auto found = streams_.find(id);
+    return found != streams_.end() ? found->second : StreamPtr();
+}
+
+bool StreamMux::peerId(uint32_t id) const {
+    return id != 0 && (id % 2 == 1) == (role_ == SERVER);
+}
+
+// Credit goes back in batches of half a window: one CREDIT frame per ~128 KB consumed.
+uint32_t StreamMux::consumedLocked(Stream& stream, size_t length) {
+    stream.unreported += static_cast<uint32_t>(length);
+    if (stream.remoteClosed || stream.unreported < INITIAL_WINDOW / 2) return 0;
+    uint32_t credit = stream.unreported;
+    stream.receiveCredit += credit;
+    stream.unreported = 0;
+    return credit;
+}
+
+void StreamMux::eraseIfDoneLocked(uint32_t id, const Stream& stream) {
+    if (stream.localClosed && stream.remoteClosed && stream.queued == 0) {
+        streams_.erase(id);
+    }
+}
+
+bool StreamMux::sendControl(FrameType type, uint8_t flags, uint32_t id, const uint32_t* value) {
+    uint8_t payload[ID_SIZE + 4];
+    writeId(id, payload);
+    if (value) writeId(*value, payload + ID_SIZE);
+    return writer_(type, flags, payload, value ? sizeof(payload) : ID_SIZE);
+}
@@ -0,0 +1,146 @@
+#include "TicketKeyRing.h"
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <cstring>
+
+namespace {
+
+// One hour per key; with three keys a ticket stays good for at least two hours.
+const std::chrono::seconds DEFAULT_ROTATION_INTERVAL(3600);
+
+bool setMacKey(EVP_MAC_CTX* mac, uint8_t* key, size_t length) {
+    char digest[] = "SHA256";
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key, length),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+        OSSL_PARAM_construct_end()
+    };
+    return EVP_MAC_CTX_set_params(mac, params) == 1;
+}
+
+}
+
+TicketKeyRing::Key::Key() {
+    std::memset(name, 0, sizeof(name));
+    std::memset(aesKey, 0, sizeof(aesKey));
+    std::memset(hmacKey, 0, sizeof(hmacKey));
+}
+
+TicketKeyRing::Key::~Key() {
+    OPENSSL_cleanse(aesKey, sizeof(aesKey));
+    OPENSSL_cleanse(hmacKey, sizeof(hmacKey));
+}
+
+TicketKeyRing::Key::Key(const Key& other) : created(other.created) {
+    std::memcpy(name, other.name, sizeof(name));
+    std::memcpy(aesKey, other.aesKey, sizeof(aesKey));
+    std::memcpy(hmacKey, other.hmacKey, sizeof(hmacKey));
+}
+
+TicketKeyRing::Key& TicketKeyRing::Key::operator=(const Key& other) {
+    std::memcpy(name, other.name, sizeof(name));
+    std::memcpy(aesKey, other.aesKey, sizeof(aesKey));
+    std::memcpy(hmacKey, other.hmacKey, sizeof(hmacKey));
+    created = other.created;
+    return *this;
+}
+
+TicketKeyRing& TicketKeyRing::instance() {
+    static TicketKeyRing ring;
+    return ring;
+}
+
+TicketKeyRing::TicketKeyRing()
+    : interval_(DEFAULT_ROTATION_INTERVAL)
+    , issued_(0)
+    , accepted_(0)
+    , unknown_(0) {
+}
+
+void TicketKeyRing::install(Poco::Net::Context& context) {
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(context.sslContext(), &TicketKeyRing::callback);
+}
+
+void TicketKeyRing::setRotationInterval(std::chrono::seconds interval) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    interval_ = interval;
+}
+
+std::chrono::seconds TicketKeyRing::rotationInterval() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return interval_;
+}
+
+std::chrono::seconds TicketKeyRing::ticketLifetime() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return interval_ * static_cast<int>(MAX_KEYS - 1);
+}
+
+bool TicketKeyRing::rotate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rotateLocked(std::chrono::steady_clock::now());
+}
+
+size_t TicketKeyRing::keys() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return keys_.size();
+}
+
+int TicketKeyRing::callback(SSL* ssl, unsigned char* name, unsigned char* iv,
+                            EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int encrypt) {
+    (void)ssl;
+    return instance().handle(name, iv, cipher, mac, encrypt);
+}
+
+// Return values follow SSL_CTX_set_tlsext_ticket_key_evp_cb: -1 error, 0 unknown key
+// (full handshake), 1 ticket accepted, 2 accepted but sealed with an older key, so a
+// fresh ticket is issued.
+int TicketKeyRing::handle(unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher,
+                          EVP_MAC_CTX* mac, int encrypt) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (keys_.empty() || now - keys_.front().created >= interval_) {
+        if (!rotateLocked(now) && keys_.empty()) return -1;
+    }
+
+    if (encrypt) {
+        Key& key = keys_.front();
+        const EVP_CIPHER* aes = EVP_aes_256_cbc();
+        if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(aes)) != 1) return -1;
+        std::memcpy(name, key.name, NAME_SIZE);
+        if (EVP_EncryptInit_ex(cipher, aes, nullptr, key.aesKey, iv) != 1
+            || !setMacKey(mac, key.hmacKey, KEY_SIZE)) {
+            return -1;
+        }
+        ++issued_;
+        return 1;
+    }
+
+    for (size_t i = 0; i < keys_.size(); ++i) {
+        Key& key = keys_[i];
+        if (std::memcmp(name, key.name, NAME_SIZE) != 0) continue;
+        if (!setMacKey(mac, key.hmacKey, KEY_SIZE)
+            || EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aesKey, iv) != 1) {
+            return -1;
+        }
+        ++accepted_;
+        return i == 0 ? 1 : 2;
+    }
+    ++unknown_;
+    return 0;
+}
+
+bool TicketKeyRing::rotateLocked(std::chrono::steady_clock::time_point now) {
+    Key key;
+    if (RAND_bytes(key.name, sizeof(key.name)) != 1
+        || RAND_bytes(key.aesKey, sizeof(key.aesKey)) != 1
+        || RAND_bytes(key.hmacKey, sizeof(key.hmacKey)) != 1) {
+        return false;
+    }
+    key.created = now;
+    keys_.insert(keys_.begin(), key);
+    if (keys_.size() > MAX_KEYS) keys_.pop_back();
+    return true;
+}
@@ -1,11 +1,25 @@
 #include "Tunnel.h" // Declares the `Tunnel` class.
+#include "ContextCache.h" // Shared SSL context for every tunnel.
 #include <Poco/Net/SSLManager.h> //From Poco library; handle SSL/TLS setup 
 #include <Poco/Net/Context.h> //and context conguration.
 #include <Poco/Net/NetException.h> // For catching Poco-specic network errors.
+#include <algorithm> // std::min
+#include <chrono> // Close timeout.
+#include <climits> // INT_MAX
+#include <future> // flush() waits for the event loop.
+#include <unistd.h> // pread
+
+namespace {
+
+// How long closeTunnel() waits for an attached connection to write what is queued and close.
+const std::chrono::seconds CLOSE_TIMEOUT(5);
+
+}
 
 // Initializes `socket_` to `nullptr` and `isConnected_` to `false`.
 //Ensures the object starts in a clean state.
-Tunnel::Tunnel() : socket_(nullptr), isConnected_(false) {
+Tunnel::Tunnel() : socket_(nullptr), isConnected_(false), latencyFirst_(false), resumed_(false),
+                   connectionClosed_(false) {
 }
 
 Tunnel::~Tunnel() {
@@ -25,22 +39,38 @@ bool Tunnel::initializeSSL() {
 
 bool Tunnel::createTunnel(const std::string& remoteAddress, int port) {
     try {
-        // Congures an SSL context for client use.
-        Poco::Net::Context::Ptr context = new Poco::Net::Context(
-            Poco::Net::Context::CLIENT_USE,
-            "",
-            "",
-            "", // No certificates (for testing or simple use cases).
-
-            Poco::Net::Context::VERIFY_RELAXED, // Relaxed SSL certificate verification.
-            9,
-            true,
-            "ALL:!ADH:!LOW:!EXP:!MD5:@STRENGTH"  // Strong encryption preferences.
-        );
+        // The client context (default CAs, cipher order, kTLS) is built once per process
+        // and shared by every tunnel; reconnects skip loading the CA bundle again.
+        Poco::Net::Context::Ptr context = ContextCache::instance().get(ContextConfig::client());
         // Creates a `SecureStreamSocket` for encrypted communication
-        socket_ = new Poco::Net::SecureStreamSocket(context); ; // Create an SSL socket.
-        // Attempts to connect to the server using the provided `remoteAddress` and `port`
-        socket_->connect(Poco::Net::SocketAddress(remoteAddress, port)); // Connect to the server.
+        // Offers the session ticket from the last connection to this endpoint, if there is one.
+        endpoint_ = SessionCache::endpoint(remoteAddress, port);
+        Poco::Net::Session::Ptr session = SessionCache::instance().get(endpoint_);
+        socket_ = new Poco::Net::SecureStreamSocket(context, session); // Create an SSL socket.
+        // Attempts to connect to the server, at the address remembered from the last lookup if any
+        try {
+            socket_->connect(SessionCache::instance().resolve(remoteAddress, port)); // Connect to the server.
+        }
+        catch (const Poco::Net::NetException& exc) {
+            // The remembered address may be stale: look the name up again on a fresh socket.
+            delete socket_;
+            socket_ = new Poco::Net::SecureStreamSocket(context, session);
+            socket_->connect(SessionCache::instance().resolve(remoteAddress, port, true));
+        }
+        socket_->completeHandshake(); // The keys reach the kernel at the end of the handshake.
+        resumed_ = socket_->sessionWasReused(); // True if the server accepted the ticket.
+        SessionCache::instance().recordHandshake(resumed_);
+        kernelTls_ = KernelTls::status(*socket_);
+        // Every write of this connection goes through the coalescer.
+        coalescer_.reset(new FrameCoalescer([this](const uint8_t* data, size_t length) {
+            return writeRecord(data, length); // One TLS record per flush.
+        }, latencyFirst_ ? FrameCoalescer::LATENCY_FIRST : FrameCoalescer::THROUGHPUT));
+        // Stream frames share the coalescer with everything else, so they never interleave.
+        FrameCoalescer* coalescer = coalescer_.get();
+        streams_.reset(new StreamMux(StreamMux::CLIENT,
+            [coalescer](FrameType type, uint8_t flags, const uint8_t* payload, size_t length) {
+                return coalescer->send(type, payload, length, flags);
+            }));
         // Sets `isConnected_` to `true` if successful.
         isConnected_ = true;
         return true;
@@ -49,40 +79,219 @@ bool Tunnel::createTunnel(const std::string& remoteAddress, int port) {
         return false; // Return false if an exception occurs (e.g., connection failure).
     }
 }
+// Writes one record from the coalescer: to the socket, or once attached, to the event loop's queue.
+bool Tunnel::writeRecord(const uint8_t* data, size_t length) {
+    if (connection_) {
+        return connection_->sendBytes(std::vector<uint8_t>(data, data + length)); // Never blocks.
+    }
+    try {
+        socket_->sendBytes(data, static_cast<int>(length));
+        return true;
+    }
+    catch (const Poco::Exception& exc) {
+        return false;
+    }
+}
+// Switches the tunnel to the event loop.
+bool Tunnel::attach(EventLoop& loop, AsyncConnection::FrameHandler onFrame,
+                    AsyncConnection::CloseHandler onClose) {
+    if (!isConnected_ || connection_) return false;
+    if (!coalescer_->flush()) return false; // Blocking writes end here.
+    onFrame_ = std::move(onFrame);
+    onClose_ = std::move(onClose);
+    connection_ = AsyncConnection::create(loop, *socket_,
+        [this](const FrameView& frame) { onAsyncFrame(frame); },
+        [this]() { onAsyncClose(); });
+    // Frames that earlier receiveFrame() calls already read but did not return come first.
+    FrameView frame;
+    while (parser_.next(frame) == FrameParser::FRAME) {
+        onAsyncFrame(frame);
+    }
+    connection_->start(); // Reads from here on happen on the loop thread.
+    return true;
+}
+// Routes a frame received on the loop thread.
+void Tunnel::onAsyncFrame(const FrameView& frame) {
+    if (StreamMux::isStreamFrame(frame.type)) {
+        if (!streams_->handleFrame(frame)) connection_->close(); // Peer broke the stream protocol.
+        return;
+    }
+    if (onFrame_) {
+        onFrame_(frame);
+        return;
+    }
+    // No handler: keep a copy for receiveFrame(); the view dies with this call.
+    ReceivedFrame received;
+    received.type = frame.type;
+    received.flags = frame.flags;
+    received.payload.assign(frame.payload, frame.payload + frame.length);
+    std::lock_guard<std::mutex> lock(inboxMutex_);
+    inbox_.push_back(std::move(received));
+    inboxChanged_.notify_all();
+}
+// Runs once on the loop thread when the connection is gone.
+void Tunnel::onAsyncClose() {
+    streams_->shutdown(); // Wake anyone waiting on a stream.
+    {
+        std::lock_guard<std::mutex> lock(inboxMutex_);
+        connectionClosed_ = true;
+        inboxChanged_.notify_all(); // Wakes receiveFrame() and closeTunnel().
+    }
+    if (onClose_) onClose_();
+}
 // Sends raw data through the secure tunnel.
 bool Tunnel::sendData(const std::vector<uint8_t>& data) {
+    // Ensures the connection is active before attempting to send data.
+    if (!isConnected_) return false;  // Ensure the tunnel is active.
+    return coalescer_->write(data.data(), data.size());  // Queue the data for the tunnel.
+}
+// Reads data from the secure tunnel into a new vector (convenience wrapper over the overload below).
+std::vector<uint8_t> Tunnel::receiveData() {
+    std::vector<uint8_t> buffer(4096); // Create a buffer to store incoming data.
+    int received = receiveData(buffer.data(), buffer.size()); // Receive data.
+    if (received <= 0) return std::vector<uint8_t>(); // Return empty if nothing arrived or on failure.
+    buffer.resize(received); // Resize the buffer to the actual received data size.
+    return buffer;
+}
+// Reads data from the secure tunnel straight into the caller's buffer.
+int Tunnel::receiveData(uint8_t* buffer, size_t capacity) {
     try {
-        // Ensures the connection is active before attempting to send data.
-        if (!isConnected_) return false;  // Ensure the tunnel is active.
-        socket_->sendBytes(data.data(), data.size());  // Send the data over the tunnel.
-        return true; 
+        if (!isConnected_) return 0; // Nothing to read if not connected.
+        if (connection_) return -1; // The event loop owns the receive side.
+        // receiveBytes takes an int length; larger buffers are simply not filled completely.
+        return socket_->receiveBytes(buffer, static_cast<int>(std::min<size_t>(capacity, INT_MAX)));
     }
     catch (const Poco::Exception& exc) {
-        return false;  // Handle transmission failure.
+        return -1;     // Handle reception failure.
     }
 }
-// Reads data from the secure tunnel into a buffer.
-std::vector<uint8_t> Tunnel::receiveData() {
+// Sends one frame through the secure tunnel.
+bool Tunnel::sendFrame(FrameType type, const uint8_t* payload, size_t length, uint8_t flags) {
+    if (!isConnected_) return false;
+    return coalescer_->send(type, payload, length, flags); // Joins the record being gathered.
+}
+// Writes everything the coalescer holds.
+bool Tunnel::flush() {
+    if (!isConnected_) return false;
+    if (!coalescer_->flush()) return false;
+    if (!connection_ || connection_->loop().inLoop()) return true; // The loop cannot wait on itself.
+
+    // Blocking wrapper over the async path: an empty send completes once everything before it is written.
+    std::shared_ptr<std::promise<bool>> written = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = written->get_future();
+    if (!connection_->sendBytes(std::vector<uint8_t>(), [written](bool ok) { written->set_value(ok); })) {
+        return false;
+    }
+    return result.get();
+}
+// Record counters of the current connection (all zero before createTunnel).
+RecordSizer::Stats Tunnel::recordStats() const {
+    return coalescer_ ? coalescer_->recordStats() : RecordSizer::Stats();
+}
+// Switches between coalescing and writing every frame at once.
+void Tunnel::setLatencyFirst(bool latencyFirst) {
+    latencyFirst_ = latencyFirst; // Remembered for later connections too.
+    if (coalescer_) {
+        coalescer_->setMode(latencyFirst ? FrameCoalescer::LATENCY_FIRST : FrameCoalescer::THROUGHPUT);
+    }
+}
+// Reads the next frame from the secure tunnel.
+bool Tunnel::receiveFrame(FrameView& frame) {
+    if (isConnected_ && connection_) {
+        if (onFrame_) return false; // Frames go to the handler instead.
+        // Blocking wrapper: wait for the event loop to queue a frame.
+        std::unique_lock<std::mutex> lock(inboxMutex_);
+        inboxChanged_.wait(lock, [this]() { return connectionClosed_ || !inbox_.empty(); });
+        if (inbox_.empty()) return false; // Connection closed.
+        received_ = std::move(inbox_.front());
+        inbox_.pop_front();
+        frame.type = received_.type;
+        frame.flags = received_.flags;
+        frame.payload = received_.payload.data();
+        frame.length = received_.payload.size();
+        return true;
+    }
     try {
-        if (!isConnected_) return std::vector<uint8_t>(); // Return empty if not connected.
-        
-        std::vector<uint8_t> buffer(4096); // Create a buffer to store incoming data.
-        int received = socket_->receiveBytes(buffer.data(), buffer.size()); // Receive data.
-        
-        if (received > 0) {
-            buffer.resize(received); // Resize the buffer to the actual received data size.
-            return buffer;
+        if (!isConnected_) return false;
+        for (;;) {
+            FrameParser::Result result = parser_.next(frame); // A frame left over from the last read?
+            if (result == FrameParser::FRAME) {
+                if (!StreamMux::isStreamFrame(frame.type)) return true;
+                if (!streams_->handleFrame(frame)) return false; // Peer broke the stream protocol.
+                continue; // Delivered to its stream; look for the next frame.
+            }
+            if (result == FrameParser::INVALID) return false; // Garbage on the stream; give up.
+
+            // Read straight into the parser's buffer, after any partial frame.
+            int received = socket_->receiveBytes(parser_.writeBuffer(), static_cast<int>(parser_.writable()));
+            if (received <= 0) return false; // Connection closed.
+            parser_.commit(static_cast<size_t>(received));
         }
-        return std::vector<uint8_t>();  // Return empty if no data is received.
     }
     catch (const Poco::Exception& exc) {
-        return std::vector<uint8_t>();     // Handle reception failure.
+        return false;     // Handle reception failure.
+    }
+}
+// Waits for the event loop to queue a frame, or to close the connection.
+bool Tunnel::waitForFrame(int timeoutMs) {
+    if (!isConnected_ || !connection_ || onFrame_) return true; // receiveFrame() does not wait.
+    std::unique_lock<std::mutex> lock(inboxMutex_);
+    return inboxChanged_.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                                  [this]() { return connectionClosed_ || !inbox_.empty(); });
+}
+// Stores the current TLS session for the next connection to this endpoint.
+void Tunnel::keepSession() {
+    if (!isConnected_) return;
+    if (!connection_) {
+        SessionCache::instance().put(endpoint_, socket_->currentSession());
+        return;
     }
+    // The loop thread owns the SSL object; a closed connection has no session left to keep.
+    AsyncConnection::Ptr connection = connection_;
+    std::string endpoint = endpoint_;
+    connection_->loop().post([connection, endpoint]() {
+        if (!connection->closed()) {
+            SessionCache::instance().put(endpoint, connection->socket().currentSession());
+        }
+    });
+}
+// Sends part of a file through the tunnel, zero-copy when kernel TLS is active.
+bool Tunnel::sendFile(int fd, int64_t offset, size_t length) {
+    if (!isConnected_ || connection_ || !coalescer_->flush()) return false; // Keep the order with queued frames.
+    if (kernelTls_.send) {
+        // The kernel encrypts: send straight from the page cache.
+        return KernelTls::sendFile(*socket_, fd, offset, length) == static_cast<long>(length);
+    }
+
+    // User-space TLS: read the file in record-sized pieces.
+    std::vector<uint8_t> chunk(FrameCoalescer::MAX_RECORD);
+    while (length > 0) {
+        ssize_t got = ::pread(fd, chunk.data(), std::min(length, chunk.size()), static_cast<off_t>(offset));
+        if (got <= 0) return false; // Read error or file shorter than expected.
+        if (!coalescer_->write(chunk.data(), static_cast<size_t>(got))) return false;
+        offset += got;
+        length -= static_cast<size_t>(got);
+    }
+    return coalescer_->flush();
 }
 // Ensures the secure tunnel is closed properly when no longer needed.
 void Tunnel::closeTunnel() {
     if (isConnected_ && socket_) {    // Check if a connection is active.
-        socket_->close();    //  close the socket.
+        streams_->shutdown();    // Wake anyone waiting on a stream.
+        coalescer_.reset();    // Write what is still queued first.
+        // By now the server's tickets have arrived; keep the newest for the next connection.
+        // On an attached tunnel this is queued on the loop ahead of the close below.
+        keepSession();
+        if (connection_) {
+            // The loop writes what is queued, then closes the socket. Its handlers point at
+            // this tunnel, so wait until they are done.
+            connection_->close();
+            std::unique_lock<std::mutex> lock(inboxMutex_);
+            inboxChanged_.wait_for(lock, CLOSE_TIMEOUT, [this]() { return connectionClosed_; });
+        }
+        else {
+            socket_->close();    //  close the socket.
+        }
         isConnected_ = false;    // Mark the tunnel as disconnected.
     }
 }
@@ -0,0 +1,129 @@
+#include "UdpChannel.h"
+#include <Poco/Exception.h>
+#include <openssl/rand.h>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+void writeBigEndian(uint64_t value, size_t bytes, uint8_t* out) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (8 * (bytes - 1 - i)));
+    }
+}
+
+uint64_t readBigEndian(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+}
+
+UdpChannelParams UdpChannelParams::generate(uint16_t port, AeadCipher::Algorithm algorithm) {
+    UdpChannelParams params;
+    uint8_t id[8];
+    if (RAND_bytes(id, sizeof(id)) != 1 || RAND_bytes(params.secret, SECRET_SIZE) != 1) {
+        throw std::runtime_error("UDP channel: random generator failed");
+    }
+    params.sessionId = readBigEndian(id, sizeof(id));
+    params.port = port;
+    params.algorithm = algorithm;
+    return params;
+}
+
+std::vector<uint8_t> UdpChannelParams::encode() const {
+    std::vector<uint8_t> out(ENCODED_SIZE);
+    writeBigEndian(sessionId, 8, out.data());
+    writeBigEndian(port, 2, out.data() + 8);
+    out[10] = static_cast<uint8_t>(algorithm);
+    std::memcpy(out.data() + 11, secret, SECRET_SIZE);
+    return out;
+}
+
+bool UdpChannelParams::parse(const uint8_t* data, size_t length, UdpChannelParams& params) {
+    if (length != ENCODED_SIZE) return false;
+    params.sessionId = readBigEndian(data, 8);
+    params.port = static_cast<uint16_t>(readBigEndian(data + 8, 2));
+    if (params.port == 0 || data[10] > AeadCipher::CHACHA20_POLY1305) return false;
+    params.algorithm = static_cast<AeadCipher::Algorithm>(data[10]);
+    std::memcpy(params.secret, data + 11, SECRET_SIZE);
+    return true;
+}
+
+UdpChannel::UdpChannel(const UdpChannelParams& params, RekeyingCipher::Role role)
+    : sessionId_(params.sessionId)
+    , cipher_(params.algorithm, params.secret, UdpChannelParams::SECRET_SIZE, role) {
+}
+
+size_t UdpChannel::seal(PacketType type, const uint8_t* payload, size_t length, uint8_t* out, size_t capacity) {
+    if (capacity < OVERHEAD || length > capacity - OVERHEAD) return 0;
+
+    writeBigEndian(sessionId_, SESSION_ID_SIZE, out);
+    uint8_t* packet = out + SESSION_ID_SIZE;
+    packet[RekeyingCipher::HEADROOM] = type;
+    if (length > 0) std::memcpy(packet + RekeyingCipher::HEADROOM + 1, payload, length);
+
+    size_t sealed = cipher_.encrypt(packet, capacity - SESSION_ID_SIZE, length + 1);
+    return sealed == 0 ? 0 : SESSION_ID_SIZE + sealed;
+}
+
+bool UdpChannel::open(uint8_t* datagram, size_t length, PacketType& type,
+                      const uint8_t*& payload, size_t& payloadLength) {
+    uint64_t id = 0;
+    if (length < OVERHEAD || !peekSessionId(datagram, length, id) || id != sessionId_) return false;
+
+    uint8_t* packet = datagram + SESSION_ID_SIZE;
+    size_t plainLength = 0;
+    if (!cipher_.decrypt(packet, length - SESSION_ID_SIZE, plainLength) || plainLength == 0) return false;
+
+    type = static_cast<PacketType>(packet[RekeyingCipher::HEADROOM]);
+    payload = packet + RekeyingCipher::HEADROOM + 1;
+    payloadLength = plainLength - 1;
+    return true;
+}
+
+bool UdpChannel::peekSessionId(const uint8_t* datagram, size_t length, uint64_t& sessionId) {
+    if (length < SESSION_ID_SIZE) return false;
+    sessionId = readBigEndian(datagram, SESSION_ID_SIZE);
+    return true;
+}
+
+bool UdpChannel::probe(Poco::Net::DatagramSocket& socket, int attempts, const Poco::Timespan& timeout) {
+    uint8_t datagram[MAX_DATAGRAM];
+    for (int attempt = 0; attempt < attempts; ++attempt) {
+        if (!send(socket, UDP_PROBE, nullptr, 0)) return false;
+        try {
+            socket.setReceiveTimeout(timeout);
+            int received = socket.receiveBytes(datagram, sizeof(datagram));
+            PacketType type;
+            const uint8_t* payload = nullptr;
+            size_t payloadLength = 0;
+            if (received > 0 && open(datagram, static_cast<size_t>(received), type, payload, payloadLength)
+                && type == UDP_PROBE_ACK) {
+                return true;
+            }
+        }
+        catch (const Poco::TimeoutException&) {
+            // No answer yet; probe again.
+        }
+        catch (const Poco::Exception&) {
+            // ICMP port unreachable shows up as a refused receive; keep trying until attempts run out.
+        }
+    }
+    return false;
+}
+
+bool UdpChannel::send(Poco::Net::DatagramSocket& socket, PacketType type, const uint8_t* payload, size_t length) {
+    uint8_t datagram[MAX_DATAGRAM];
+    size_t size = seal(type, payload, length, datagram, sizeof(datagram));
+    if (size == 0) return false;
+    try {
+        return socket.sendBytes(datagram, static_cast<int>(size)) == static_cast<int>(size);
+    }
+    catch (const Poco::Exception&) {
+        return false;
+    }
+}
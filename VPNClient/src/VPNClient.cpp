@@ -1,139 +1,496 @@
-#include <Poco/Net/SecureStreamSocket.h> //Handles encrypted communication.
+#include "VPNClient.h"
 #include <Poco/Net/SSLManager.h> // Initializes and manages SSL/TLS
-#include <Poco/Net/Context.h>    //Congures SSL context for secure connections.
 #include <Poco/Net/NetException.h>    //Manages exceptions for network errors
-#include <Poco/Util/Application.h> //implements the main subsystem in a process. The application class is responsible for initializing all its subsystems.
 #include <Poco/Thread.h>
+#include <algorithm>
 #include <iostream>
-#include <vector>
-#include <string>
-
-class VPNClient {     //`VPNClient` class manages a secure VPN connection using SSL/TLS
-private:
-    Poco::Net::SecureStreamSocket socket; // The secure socket for communication.
-    std::string serverAddress;    // Server's IP or hostname.
-    uint16_t serverPort;          // Server's port number.
-    bool isConnected;             // Connection status.
-    std::vector<uint8_t> buffer;  // Buffer for receiving data.
-    static const size_t BUFFER_SIZE = 4096; // Default buffer size for data transmission.
-
-    // SSL Context
-    Poco::Net::Context::Ptr getSSLContext() {
-        return new Poco::Net::Context(
-            Poco::Net::Context::CLIENT_USE,    // SSL client mode.
-            "",  // certificatePath
-            "",  // privateKeyPath
-            "",  // caLocation
-            Poco::Net::Context::VERIFY_RELAXED,
-            9,   // verificationDepth
-            true // loadDefaultCAs
-        );
-    }
-
-public:
-    VPNClient(const std::string& address, uint16_t port) //Takes server address and port as input.
-        : serverAddress(address)
-        , serverPort(port)
-        , isConnected(false)
-        , buffer(BUFFER_SIZE) {
-        
-        // Initialize SSL
-        Poco::Net::initializeSSL(); //Initializes SSL  using `initializeSSL`.
+#include <thread>
+
+VPNClient::VPNClient(const std::string& address, uint16_t port, const std::string& encryptionKey, bool enableUdp)
+    : serverAddress(address)
+    , serverPort(port)
+    , isConnected(false)
+    , latencyFirst(false)
+    , earlyData(false)
+    , encryptionKey(encryptionKey)
+    , protectionMode(PROTECTION_NONE)
+    , udpWanted(enableUdp)
+    , udpActive(false)
+    , udpReceiving(false)
+    , udpProbeAnswered(false) {
+
+    // Initialize SSL
+    Poco::Net::initializeSSL(); //Initializes SSL  using `initializeSSL`.
+}
+
+VPNClient::~VPNClient() {
+    disconnect();    // Ensure the connection is closed.
+    Poco::Net::uninitializeSSL(); // Clean up SSL resources.
+}
+
+void VPNClient::sendOffer() {
+    uint8_t modes = PROTECTION_TLS_ONLY | (encryptionKey.empty() ? PROTECTION_NONE : PROTECTION_DOUBLE);
+    std::vector<uint8_t> offer = ProtectionNegotiation::offer(modes);
+    sendFrame(FRAME_HELLO, offer.data(), offer.size());
+}
+
+bool VPNClient::negotiateProtection() {
+    tunnel->flush(); // The reply is needed now.
+
+    FrameView reply;
+    if (!receiveFrame(reply) || reply.type != FRAME_HELLO
+        || !ProtectionNegotiation::parseReply(reply.payload, reply.length, protectionMode)) {
+        std::cerr << "Server did not agree on a protection mode" << std::endl;
+        return false;
+    }
+
+    if (protectionMode == PROTECTION_DOUBLE) {
+        session.reset(new EncryptionSession(encryptionKey));
+    }
+    else {
+        session.reset(); // TLS already protects every byte.
+    }
+    std::cout << "Tunnel protection: " << ProtectionNegotiation::name(protectionMode) << std::endl;
+    return true;
+}
+
+void VPNClient::setupUdp(bool requested) {
+    udpActive = false;
+    udp.reset();
+    if (!requested) {
+        sendFrame(FRAME_UDP_REQUEST, nullptr, 0);
+    }
+    tunnel->flush();
+
+    FrameView reply;
+    UdpChannelParams params;
+    if (!receiveFrame(reply) || reply.type != FRAME_UDP_PARAMS) {
+        throw Poco::IOException("No answer to the UDP channel request");
     }
+    if (!UdpChannelParams::parse(reply.payload, reply.length, params)) {
+        std::cout << "Data channel: TCP (server offers no UDP)" << std::endl;
+        return;
+    }
+
+    udpSocket = Poco::Net::DatagramSocket();
+    udpSocket.connect(Poco::Net::SocketAddress(serverAddress, params.port));
+    udp.reset(new UdpChannel(params, RekeyingCipher::CLIENT));
+    std::lock_guard<std::mutex> lock(udpMutex);
+    if (udp->probe(udpSocket, UDP_PROBE_ATTEMPTS, Poco::Timespan(0, UDP_PROBE_TIMEOUT_US))) {
+        udpActive = true;
+        std::cout << "Data channel: UDP port " << params.port << std::endl;
+    }
+    else {
+        std::cout << "Data channel: TCP (UDP blocked)" << std::endl;
+    }
+}
+
+void VPNClient::sendFrame(FrameType type, const uint8_t* payload, size_t length) {
+    if (!tunnel->sendFrame(type, payload, length)) {
+        throw Poco::IOException("Write to VPN server failed");
+    }
+}
+
+void VPNClient::queueData(const std::vector<uint8_t>& data) {
+    size_t offset = 0;
+    do {
+        size_t length = std::min(data.size() - offset, static_cast<size_t>(Framing::MAX_PAYLOAD));
+        sendFrame(FRAME_DATA, data.data() + offset, length);     // Queue it; small frames share a record.
+        offset += length;
+    } while (offset < data.size());
+}
 
-    ~VPNClient() {
-        disconnect();    // Ensure the connection is closed.
-        Poco::Net::uninitializeSSL(); // Clean up SSL resources.
+bool VPNClient::receiveFrame(FrameView& frame) {
+    return tunnel->receiveFrame(frame); // Waits for the loop; a malformed stream closes the connection.
+}
+
+bool VPNClient::sendOverUdp(const uint8_t* data, size_t length) {
+    if (!udpActive || length > UdpChannel::MAX_PAYLOAD) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(udpMutex);
+    if (udp->send(udpSocket, UdpChannel::UDP_DATA, data, length)) {
+        return true;
     }
-    //Establishes a secure connection with the server , Completes the SSL handshake for authentication
-    bool connect() {
+    std::cerr << "UDP send failed, falling back to TCP" << std::endl;
+    udpActive = false;
+    return false;
+}
+
+bool VPNClient::sendBatch(const PacketBatch& batch) {
+    std::lock_guard<std::mutex> lock(sendMutex); // One queue's batch at a time.
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (!sendPacket(batch.data(i), batch.length(i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VPNClient::sendPacket(const uint8_t* packet, size_t length) {
+    if (session) {
         try {
-            // Create SSL context and socket
-            Poco::Net::Context::Ptr context = getSSLContext();
-            socket = Poco::Net::SecureStreamSocket(context);
-            
-            // Connect to server
-            Poco::Net::SocketAddress addr(serverAddress, serverPort);
-            socket.connect(addr);
-            
-            // Perform SSL handshake
-            socket.completeHandshake();
-            
-            isConnected = true; // Mark as connected.
-            std::cout << "Successfully connected to VPN server" << std::endl;
-            return true;
-        }
-        catch (Poco::Net::NetException& e) {
-            std::cerr << "Connection error: " << e.what() << std::endl;
-            isConnected = false;
+            return sendData(session->encrypt(std::vector<uint8_t>(packet, packet + length)));
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error encrypting data: " << e.what() << std::endl;
             return false;
         }
     }
-    // Safely terminates the connection and cleans up resources.
-    void disconnect() {
-        if (isConnected) {
-            try {
-                socket.shutdown();    // shut down the connection.
-                socket.close();    // Close the socket.
-                isConnected = false;
-                std::cout << "Disconnected from VPN server" << std::endl;
+    if (sendOverUdp(packet, length)) {
+        return true;
+    }
+    try {
+        sendFrame(FRAME_DATA, packet, length); // Packets of one batch share TLS records.
+        return true;
+    }
+    catch (Poco::Exception& e) {
+        std::cerr << "Error sending data: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool VPNClient::connect() {
+    return connect(std::vector<uint8_t>());
+}
+
+bool VPNClient::connect(const std::vector<uint8_t>& firstData) {
+    try {
+        if (!loop) {
+            loop.reset(new EventLoop());
+        }
+        // Offers the ticket from the last connection, if any, and skips DNS if the address
+        // is remembered (also across restarts); a resumed handshake is a PSK resumption.
+        tunnel.reset(new Tunnel());
+        tunnel->setLatencyFirst(latencyFirst);
+        if (!tunnel->createTunnel(serverAddress, serverPort)) {
+            std::cerr << "Connection error: cannot reach " << serverAddress << ":" << serverPort << std::endl;
+            tunnel.reset();
+            return false;
+        }
+        // From here on the loop thread alone reads and writes the TLS socket; every other
+        // thread only queues frames, so OpenSSL never sees two callers at once.
+        if (!tunnel->attach(*loop)) {
+            tunnel.reset();
+            return false;
+        }
+
+        // Agree on single (TLS only) or double encryption. With early data the offer is
+        // TLS only, so the UDP request and the first data need not wait for the answer.
+        bool pipelined = earlyData && encryptionKey.empty();
+        sendOffer();
+        if (pipelined) {
+            if (udpWanted) {
+                sendFrame(FRAME_UDP_REQUEST, nullptr, 0);
             }
-            catch (Poco::Exception& e) {
-                std::cerr << "Error during disconnect: " << e.what() << std::endl;
+            if (!firstData.empty()) {
+                queueData(firstData);
             }
         }
-    }
-
-    bool sendData(const std::vector<uint8_t>& data) {
-        if (!isConnected) {
-            std::cerr << "Not connected to server" << std::endl;
+        if (!negotiateProtection()) {
+            tunnel.reset();
             return false;
         }
+        // The server's tickets came in with its reply; keep the newest for the next connect.
+        tunnel->keepSession();
+        if (udpWanted) {
+            setupUdp(pipelined);    // Falls back to TCP on its own if UDP is blocked.
+        }
+        
+        isConnected = true; // Mark as connected.
+        if (!pipelined && !firstData.empty() && !sendSecureData(firstData)) {
+            disconnect();
+            return false;
+        }
+        std::cout << "Successfully connected to VPN server"
+                  << (tunnel->sessionResumed() ? " (TLS session resumed)" : "") << std::endl;
+        std::cout << "Kernel TLS: " << tunnel->kernelTls().toString() << std::endl;
+        return true;
+    }
+    catch (Poco::Net::NetException& e) {
+        std::cerr << "Connection error: " << e.what() << std::endl;
+        tunnel.reset();
+        isConnected = false;
+        return false;
+    }
+    catch (std::exception& e) {    // Inner-layer setup or UDP failure during negotiation.
+        std::cerr << "Negotiation error: " << e.what() << std::endl;
+        tunnel.reset();
+        isConnected = false;
+        return false;
+    }
+}
+
+void VPNClient::disconnect() {
+    if (isConnected) {
         try {
-            socket.sendBytes(data.data(), data.size());     // Send data over the secure socket.
-            return true;
+            udpActive = false;
+            udpSocket.close();
+            tunnel->flush();    // Write what is still queued.
+            std::cout << "TLS records: " << tunnel->recordStats().toString() << std::endl;
+            tunnel->closeTunnel();    // The loop writes the rest, then closes the socket.
+            tunnel.reset();
+            isConnected = false;
+            std::cout << "Disconnected from VPN server" << std::endl;
         }
         catch (Poco::Exception& e) {
-            std::cerr << "Error sending data: " << e.what() << std::endl;
-            return false;
+            std::cerr << "Error during disconnect: " << e.what() << std::endl;
         }
     }
-    // Reads data securely from the server into a buer.
-    std::vector<uint8_t> receiveData() {
-        if (!isConnected) {
-            std::cerr << "Not connected to server" << std::endl;
+}
+
+bool VPNClient::sendData(const std::vector<uint8_t>& data) {
+    if (!isConnected) {
+        std::cerr << "Not connected to server" << std::endl;
+        return false;
+    }
+    // Packet-sized data takes the UDP channel: no head-of-line blocking behind lost segments.
+    if (sendOverUdp(data.data(), data.size())) {
+        return true;
+    }
+    try {
+        queueData(data); // Payloads larger than one frame go out as several DATA frames.
+        return true;
+    }
+    catch (Poco::Exception& e) {
+        std::cerr << "Error sending data: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+std::vector<uint8_t> VPNClient::receiveData() {
+    if (!isConnected) {
+        std::cerr << "Not connected to server" << std::endl;
+        return std::vector<uint8_t>();
+    }
+
+    try {
+        tunnel->flush(); // Whatever we are waiting for may depend on queued frames.
+        FrameView frame;
+        while (receiveFrame(frame)) {
+            if (frame.type == FRAME_DATA) {
+                return std::vector<uint8_t>(frame.payload, frame.payload + frame.length);
+            }
+            // FRAME_PONG only proves the connection is alive; nothing to return.
+        }
+    }
+    catch (Poco::Exception& e) {
+        std::cerr << "Error receiving data: " << e.what() << std::endl;
+    }
+
+    return std::vector<uint8_t>();    // Return empty vector on failure.
+}
+
+bool VPNClient::sendSecureData(const std::vector<uint8_t>& data) {
+    if (!session) {
+        return sendData(data);
+    }
+    std::lock_guard<std::mutex> lock(sendMutex); // The inner layer has one sender at a time.
+    try {
+        return sendData(session->encrypt(data));
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error encrypting data: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+std::vector<uint8_t> VPNClient::receiveSecureData() {
+    if (!session) {
+        return receiveData();
+    }
+    if (!isConnected) {
+        std::cerr << "Not connected to server" << std::endl;
+        return std::vector<uint8_t>();
+    }
+    tunnel->flush(); // Whatever we are waiting for may depend on queued frames.
+    std::vector<uint8_t> data;
+    for (;;) {
+        switch (receivePacket(data)) {
+        case RECEIVED:
+            return data;
+        case CLOSED:
             return std::vector<uint8_t>();
+        case SKIPPED:
+            break;    // Keep waiting for data.
+        }
+    }
+}
+
+VPNClient::ReceiveResult VPNClient::receivePacket(std::vector<uint8_t>& packet) {
+    FrameView frame;
+    try {
+        if (!receiveFrame(frame)) {
+            return CLOSED;
         }
+    }
+    catch (Poco::Exception& e) {
+        std::cerr << "Error receiving data: " << e.what() << std::endl;
+        return CLOSED;
+    }
+    if (frame.type != FRAME_DATA) {
+        return SKIPPED; // FRAME_PONG only proves the connection is alive.
+    }
+    if (!session) {
+        packet.assign(frame.payload, frame.payload + frame.length);
+        return RECEIVED;
+    }
+    try {
+        packet = session->decrypt(std::vector<uint8_t>(frame.payload, frame.payload + frame.length));
+        return RECEIVED;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Dropped undecryptable data: " << e.what() << std::endl;
+        return SKIPPED;
+    }
+}
 
+void VPNClient::receiveUdp(PacketQueues& queues, const std::atomic<bool>& stop) {
+    uint8_t datagram[UdpChannel::MAX_DATAGRAM];
+    udpSocket.setReceiveTimeout(Poco::Timespan(0, UDP_RECEIVE_TIMEOUT_US));
+    while (!stop) {
         try {
-            int received = socket.receiveBytes(buffer.data(), BUFFER_SIZE);
-            if (received > 0) {
-                return std::vector<uint8_t>(buffer.begin(), buffer.begin() + received);
+            int received = udpSocket.receiveBytes(datagram, sizeof(datagram));
+            UdpChannel::PacketType type;
+            const uint8_t* payload = nullptr;
+            size_t length = 0;
+            // Forgeries and replays are dropped like on the server.
+            if (received <= 0 || !udp->open(datagram, static_cast<size_t>(received), type, payload, length)) {
+                continue;
             }
+            if (type == UdpChannel::UDP_PROBE_ACK) {
+                udpProbeAnswered = true;
+                continue;
+            }
+            if (type != UdpChannel::UDP_DATA) {
+                continue;
+            }
+            if (!session) {
+                queues.write(payload, length);
+                continue;
+            }
+            std::vector<uint8_t> packet = session->decrypt(std::vector<uint8_t>(payload, payload + length));
+            queues.write(packet.data(), packet.size());
         }
-        catch (Poco::Exception& e) {
-            std::cerr << "Error receiving data: " << e.what() << std::endl;
+        catch (Poco::TimeoutException&) {
+            // Nothing from the server; look at `stop` again.
         }
+        catch (Poco::Exception&) {
+            // ICMP errors show up as failed receives; the channel itself may still work.
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error decrypting UDP data: " << e.what() << std::endl;
+        }
+    }
+}
 
-        return std::vector<uint8_t>();    // Return empty vector on failure.
+bool VPNClient::runPacketTunnel(PacketSource& source) {
+    PacketQueues queues({std::shared_ptr<PacketSource>(&source, [](PacketSource*) {})});
+    return runPacketTunnel(queues);
+}
+
+bool VPNClient::runPacketTunnel(PacketQueues& queues) {
+    if (!isConnected) {
+        std::cerr << "Not connected to server" << std::endl;
+        return false;
+    }
+    std::atomic<bool> sourceClosed(false);
+    std::atomic<bool> stopping(false); // Set by whichever side ends the tunnel first.
+    std::vector<std::thread> uplinks;
+    for (size_t queue = 0; queue < queues.size(); ++queue) {
+        uplinks.emplace_back([this, &queues, &sourceClosed, &stopping, queue]() {
+            if (queues.size() > 1) {
+                PacketQueues::pinToCore(queue);
+            }
+            PacketBatch batch;
+            while (isConnected && !stopping) {
+                batch.clear();
+                if (queues.queue(queue).readBatch(batch, 500) < 0) {
+                    sourceClosed = !stopping; // Not our own close below.
+                    break;
+                }
+                if (batch.size() > 0 && (!sendBatch(batch) || !flush())) {
+                    break;
+                }
+            }
+            stopping = true; // Ends the downlink loops below.
+        });
     }
 
-    bool isActive() const {
-        return isConnected;
+    // The server sends the downlink as datagrams once the UDP channel works, and as
+    // DATA frames otherwise; both are read until the tunnel ends.
+    std::thread udpDownlink;
+    if (udp && udpActive) {
+        {
+            std::lock_guard<std::mutex> lock(udpMutex); // Waits for a probe in progress.
+            udpProbeAnswered = true;
+            udpReceiving = true;
+        }
+        udpDownlink = std::thread([this, &queues, &stopping]() { receiveUdp(queues, stopping); });
     }
 
-    // Implement ping to keep connection alive
-    void keepAlive() {
-        while (isConnected) {
-            try {
-                std::vector<uint8_t> pingData = {0x01}; // Simple ping packet
-                sendData(pingData);    // Send a ping packet.
-                Poco::Thread::sleep(30000); // Sleep for 30 seconds
-            }
-            catch (Poco::Exception& e) {
-                std::cerr << "Keep-alive error: " << e.what() << std::endl;
-                break;
+    std::vector<uint8_t> packet;
+    while (!stopping) {
+        if (!tunnel->waitForFrame(DOWNLINK_POLL_MS)) {
+            continue; // Nothing yet; look at `stopping` again.
+        }
+        ReceiveResult result = receivePacket(packet);
+        if (result == CLOSED) break; // The server went away.
+        if (result == RECEIVED) {
+            queues.write(packet.data(), packet.size());
+        }
+    }
+    stopping = true;
+    queues.close(); // Stops the uplinks if the server went away.
+    for (std::thread& uplink : uplinks) {
+        uplink.join();
+    }
+    if (udpDownlink.joinable()) {
+        udpDownlink.join();
+        udpReceiving = false;
+    }
+    return sourceClosed;
+}
+
+bool VPNClient::flush() {
+    return isConnected && tunnel->flush();
+}
+
+void VPNClient::setEarlyData(bool enabled) {
+    earlyData = enabled;
+}
+
+void VPNClient::setLatencyFirst(bool enabled) {
+    latencyFirst = enabled;
+    if (tunnel) {
+        tunnel->setLatencyFirst(enabled);
+    }
+}
+
+RecordSizer::Stats VPNClient::recordStats() const {
+    return tunnel ? tunnel->recordStats() : RecordSizer::Stats();
+}
+
+void VPNClient::keepAlive() {
+    while (isConnected) {
+        try {
+            sendFrame(FRAME_PING, nullptr, 0);    // Send a ping frame.
+            if (udpActive) {
+                // Also checks that the UDP path still works; NAT mappings and firewalls change.
+                std::lock_guard<std::mutex> lock(udpMutex);
+                bool working = udpReceiving
+                    ? udpProbeAnswered.exchange(false) && udp->send(udpSocket, UdpChannel::UDP_PROBE, nullptr, 0)
+                    : udp->probe(udpSocket, UDP_PROBE_ATTEMPTS, Poco::Timespan(0, UDP_PROBE_TIMEOUT_US));
+                if (!working) {
+                    std::cerr << "UDP data channel lost, falling back to TCP" << std::endl;
+                    udpActive = false;
+                }
             }
+            Poco::Thread::sleep(30000); // Sleep for 30 seconds
+        }
+        catch (Poco::Exception& e) {
+            std::cerr << "Keep-alive error: " << e.what() << std::endl;
+            break;
         }
     }
-};
+}
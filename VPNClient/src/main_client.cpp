@@ -1,13 +1,68 @@
-#include "include/VPNClient.h" //Includes the class denition for managing the VPN client.
+#include "VPNClient.h" //Includes the class denition for managing the VPN client.
+#include "CipherSelector.h" //Detects CPU features and picks the fastest cipher at startup.
+#include "SessionCache.h" //Keeps TLS tickets and server addresses for the next run.
+#include "TunDevice.h" //Carries IP packets when VPN_TUN names an interface.
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
 #include <iostream>    // Used for console input/output operations.
 
+namespace {
+
+// Opens the queues of TUN interface `name`: VPN_TUN_QUEUES of them, one per core by
+// default, or a single queue when the device is not multi-queue.
+PacketQueues openTunQueues(const char* name) {
+    const char* configured = std::getenv("VPN_TUN_QUEUES");
+    unsigned queues = configured ? static_cast<unsigned>(std::atoi(configured)) : std::thread::hardware_concurrency();
+    try {
+        return TunDevice::openQueues(name, queues);
+    }
+    catch (const std::runtime_error& e) {
+        if (queues <= 1) throw;
+        std::cerr << e.what() << ", using one queue" << std::endl;
+        return TunDevice::openQueues(name, 1);
+    }
+}
+
+}
+
 int main() {
     try {
-        VPNClient client; //Creating VPNClient Object
+        // Benchmarks AES-GCM against ChaCha20-Poly1305 once, before any connection is made.
+        std::cout << "Cipher selection: " << CipherSelector::instance().describe() << std::endl;
+
+        // Tickets and addresses from the last run let the first connect resume in one round trip.
+        // Set VPN_NO_SESSION_STORE to always start with a full handshake.
+        if (!std::getenv("VPN_NO_SESSION_STORE")) {
+            try {
+                std::shared_ptr<SessionStore> store = std::make_shared<SessionStore>(SessionStore::defaultPath());
+                SessionCache::instance().setStore(store);
+                std::cout << "Session store: " << store->path() << std::endl;
+            }
+            catch (const std::runtime_error& e) {
+                std::cerr << e.what() << ", continuing without it" << std::endl;
+            }
+        }
+
+        // VPN_TUN names a TUN interface whose IP packets go through the tunnel; without it
+        // one greeting is sent as a demonstration.
+        PacketQueues tun;
+        if (const char* name = std::getenv("VPN_TUN")) {
+            tun = openTunQueues(name);
+        }
+
+        VPNClient client("localhost", 8443); //Creating VPNClient Object
         
         std::cout << "Connecting to VPN Server..." << std::endl;
-        if (client.connect("localhost", 8443)) {
+        if (client.connect()) {
             std::cout << "Connected successfully!" << std::endl;
+
+            if (!tun.empty()) {
+                std::cout << "Carrying packets of " << tun.name() << std::endl;
+                client.runPacketTunnel(tun); // Until the server goes away.
+                client.disconnect();
+                return 0;
+            }
             
             // Example data transmission - Send Encrypted Data
             //Converts a string message (`"Hello, VPN Server!"`) to a `std::vector<uint8_t>` for encryption and secure transmission.
@@ -0,0 +1,45 @@
+// Per-packet cost of the static Encryption API (cipher rebuilt on every call)
+// against EncryptionSession (cipher built once) for a few representative payloads.
+#include "Encryption.h"
+#include "EncryptionSession.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+const std::string KEY = "0123456789abcdef0123456789abcdef";
+
+template <typename Fn>
+double nsPerPacket(int iterations, Fn&& fn) {
+    fn(); // warm up
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        fn();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+}
+
+int main() {
+    const size_t sizes[] = {64, 1400, 16 * 1024};
+    EncryptionSession session(KEY);
+
+    std::printf("%-8s %-10s %16s %16s %10s\n", "size", "op", "static ns/pkt", "session ns/pkt", "speedup");
+    for (size_t size : sizes) {
+        std::vector<uint8_t> plain(size, 0xA5);
+        std::vector<uint8_t> cipher = session.encrypt(plain);
+        int iterations = size > 4096 ? 200 : 1000;
+
+        double staticEnc = nsPerPacket(iterations, [&] { Encryption::encrypt(plain, KEY); });
+        double sessionEnc = nsPerPacket(iterations * 10, [&] { session.encrypt(plain); });
+        std::printf("%-8zu %-10s %16.0f %16.0f %9.1fx\n", size, "encrypt", staticEnc, sessionEnc, staticEnc / sessionEnc);
+
+        double staticDec = nsPerPacket(iterations, [&] { Encryption::decrypt(cipher, KEY); });
+        double sessionDec = nsPerPacket(iterations * 10, [&] { session.decrypt(cipher); });
+        std::printf("%-8zu %-10s %16.0f %16.0f %9.1fx\n", size, "decrypt", staticDec, sessionDec, staticDec / sessionDec);
+    }
+    return 0;
+}
@@ -0,0 +1,221 @@
+// Loopback time-to-first-byte of a tunnel connection.
+//
+// A server thread on 127.0.0.1 answers the connection setup the way VPNServer does
+// (protection reply, UDP parameters) and echoes DATA frames. The client measures the
+// time from connect() until the echo of its first data arrives, for every combination
+// of:
+//   - full handshake or resumed TLS session (SessionCache ticket), and
+//   - sequential setup (offer, UDP request, data, one round trip each) or the
+//     pipelined first flight of VPNClient::setEarlyData (all three in one record).
+//
+//     vpn_ttfb_bench [--iterations N] [--cert server.crt] [--key server.key] > ttfb_bench.json
+//
+// Loopback hides most of the round trips; add latency to see them, for example
+// `tc qdisc add dev lo root netem delay 10ms`.
+#include "ContextCache.h"
+#include "Framing.h"
+#include "ProtectionMode.h"
+#include "SessionCache.h"
+#include <Poco/Net/SSLManager.h>
+#include <Poco/Net/SecureStreamSocket.h>
+#include <Poco/Net/ServerSocket.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef VPN_PROJECT
+#define VPN_PROJECT "unknown"
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const size_t DATA_SIZE = 1200;
+
+double millisSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void sendFrames(Poco::Net::SecureStreamSocket& socket, const std::vector<uint8_t>& frames) {
+    socket.sendBytes(frames.data(), static_cast<int>(frames.size()));
+}
+
+bool receiveFrame(Poco::Net::SecureStreamSocket& socket, FrameParser& parser, FrameView& frame) {
+    for (;;) {
+        FrameParser::Result result = parser.next(frame);
+        if (result == FrameParser::FRAME) return true;
+        if (result == FrameParser::INVALID) return false;
+        int received = socket.receiveBytes(parser.writeBuffer(), static_cast<int>(parser.writable()));
+        if (received <= 0) return false;
+        parser.commit(static_cast<size_t>(received));
+    }
+}
+
+// Server end of one connection, answering like VPNServer::handleClient.
+void serve(Poco::Net::SecureStreamSocket socket) {
+    try {
+        FrameParser parser;
+        FrameView frame;
+        std::vector<uint8_t> out;
+        while (receiveFrame(socket, parser, frame)) {
+            out.clear();
+            if (frame.type == FRAME_HELLO) {
+                std::vector<uint8_t> reply = ProtectionNegotiation::reply(PROTECTION_TLS_ONLY);
+                Framing::append(out, FRAME_HELLO, 0, reply.data(), reply.size());
+            }
+            else if (frame.type == FRAME_UDP_REQUEST) {
+                Framing::append(out, FRAME_UDP_PARAMS, 0, nullptr, 0);    // No UDP: TCP only.
+            }
+            else if (frame.type == FRAME_DATA) {
+                Framing::append(out, FRAME_DATA, 0, frame.payload, frame.length);
+            }
+            if (!out.empty()) sendFrames(socket, out);
+        }
+    }
+    catch (const Poco::Exception&) {
+        // Client went away.
+    }
+}
+
+void acceptLoop(Poco::Net::ServerSocket& listener, const ContextConfig& config, std::atomic<bool>& running) {
+    while (running) {
+        try {
+            Poco::Net::StreamSocket plain = listener.acceptConnection();
+            serve(Poco::Net::SecureStreamSocket::attach(plain, ContextCache::instance().get(config)));
+        }
+        catch (const Poco::Exception&) {
+            // Timeout: check `running` again.
+        }
+    }
+}
+
+struct Result {
+    std::vector<double> ms;
+    unsigned resumed = 0;
+    unsigned failed = 0;
+};
+
+// One connection; returns the time to the first echoed byte, or a negative value on failure.
+double connectOnce(const Poco::Net::SocketAddress& address, const ContextConfig& config,
+                   bool resume, bool pipelined, bool& resumed) {
+    std::string endpoint = SessionCache::endpoint("127.0.0.1", address.port());
+    if (!resume) SessionCache::instance().remove(endpoint);
+
+    std::vector<uint8_t> offer = ProtectionNegotiation::offer(PROTECTION_TLS_ONLY);
+    std::vector<uint8_t> data(DATA_SIZE, 0x5a);
+    std::vector<uint8_t> hello, request, payload;
+    Framing::append(hello, FRAME_HELLO, 0, offer.data(), offer.size());
+    Framing::append(request, FRAME_UDP_REQUEST, 0, nullptr, 0);
+    Framing::append(payload, FRAME_DATA, 0, data.data(), data.size());
+
+    Clock::time_point start = Clock::now();
+    Poco::Net::SecureStreamSocket socket(ContextCache::instance().get(config), SessionCache::instance().get(endpoint));
+    socket.connect(address);
+    socket.completeHandshake();
+    resumed = socket.sessionWasReused();
+
+    FrameParser parser;
+    FrameView frame;
+    if (pipelined) {
+        std::vector<uint8_t> flight(hello);
+        flight.insert(flight.end(), request.begin(), request.end());
+        flight.insert(flight.end(), payload.begin(), payload.end());
+        sendFrames(socket, flight);
+        for (FrameType expected : {FRAME_HELLO, FRAME_UDP_PARAMS, FRAME_DATA}) {
+            if (!receiveFrame(socket, parser, frame) || frame.type != expected) return -1;
+        }
+    }
+    else {
+        sendFrames(socket, hello);
+        if (!receiveFrame(socket, parser, frame) || frame.type != FRAME_HELLO) return -1;
+        sendFrames(socket, request);
+        if (!receiveFrame(socket, parser, frame) || frame.type != FRAME_UDP_PARAMS) return -1;
+        sendFrames(socket, payload);
+        if (!receiveFrame(socket, parser, frame) || frame.type != FRAME_DATA) return -1;
+    }
+    double ms = millisSince(start);
+
+    SessionCache::instance().put(endpoint, socket.currentSession());    // Ticket for the next run.
+    socket.shutdown();
+    socket.close();
+    return ms;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[static_cast<size_t>(p * (values.size() - 1))];
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    unsigned iterations = 50;
+    std::string cert = "server.crt";
+    std::string key = "server.key";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--iterations") == 0) iterations = static_cast<unsigned>(std::strtoul(argv[i + 1], nullptr, 10));
+        else if (std::strcmp(argv[i], "--cert") == 0) cert = argv[i + 1];
+        else if (std::strcmp(argv[i], "--key") == 0) key = argv[i + 1];
+    }
+
+    try {
+        Poco::Net::initializeSSL();
+        ContextConfig serverConfig = ContextConfig::server(cert, key, "");
+        ContextConfig clientConfig = ContextConfig::client();
+        clientConfig.verificationMode = Poco::Net::Context::VERIFY_NONE;    // Self-signed test certificate.
+        ContextCache::instance().get(serverConfig);
+
+        Poco::Net::ServerSocket listener(Poco::Net::SocketAddress("127.0.0.1", 0));
+        listener.setReceiveTimeout(Poco::Timespan(0, 200000));
+        std::atomic<bool> running(true);
+        std::thread server(acceptLoop, std::ref(listener), std::cref(serverConfig), std::ref(running));
+
+        const char* names[] = {"full_sequential", "full_pipelined", "resumed_sequential", "resumed_pipelined"};
+        Result results[4];
+        for (int mode = 0; mode < 4; ++mode) {
+            bool resume = mode >= 2;
+            bool pipelined = (mode % 2) == 1;
+            bool resumed = false;
+            if (resume) connectOnce(listener.address(), clientConfig, false, false, resumed);    // Fetch a ticket.
+            for (unsigned i = 0; i < iterations; ++i) {
+                double ms = -1;
+                try {
+                    ms = connectOnce(listener.address(), clientConfig, resume, pipelined, resumed);
+                }
+                catch (const Poco::Exception&) {
+                }
+                if (ms < 0) {
+                    ++results[mode].failed;
+                    continue;
+                }
+                results[mode].ms.push_back(ms);
+                if (resumed) ++results[mode].resumed;
+            }
+        }
+        running = false;
+        server.join();
+
+        std::printf("{\n  \"benchmark\": \"vpn_ttfb_bench\",\n  \"project\": \"%s\",\n", VPN_PROJECT);
+        std::printf("  \"iterations\": %u,\n  \"data_size\": %zu,\n  \"modes\": {\n", iterations, DATA_SIZE);
+        for (int mode = 0; mode < 4; ++mode) {
+            std::printf("    \"%s\": {\"median_ms\": %.3f, \"p90_ms\": %.3f, \"resumed\": %u, \"failed\": %u}%s\n",
+                        names[mode], percentile(results[mode].ms, 0.5), percentile(results[mode].ms, 0.9),
+                        results[mode].resumed, results[mode].failed, mode < 3 ? "," : "");
+        }
+        std::printf("  }\n}\n");
+        Poco::Net::uninitializeSSL();
+        return results[0].failed + results[1].failed + results[2].failed + results[3].failed == 0 ? 0 : 1;
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "vpn_ttfb_bench: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,125 @@
+// Localhost check of the UDP data channel, no TLS server needed.
+//
+// A responder thread plays the server side of one session on 127.0.0.1. The bench
+// probes it, pushes a burst of sealed packets through and counts what arrived, then
+// probes a port nobody listens on to time the fallback to TCP. Results are JSON:
+//
+//     vpn_udp_bench [--packets N] [--size N] > udp_bench.json
+#include "UdpChannel.h"
+#include <Poco/Net/DatagramSocket.h>
+#include <Poco/Net/SocketAddress.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifndef VPN_PROJECT
+#define VPN_PROJECT "unknown"
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double millisSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Server end of one session: acknowledges probes and counts data packets.
+void respond(Poco::Net::DatagramSocket& socket, UdpChannel& channel,
+             std::atomic<bool>& running, std::atomic<unsigned long>& delivered) {
+    uint8_t datagram[UdpChannel::MAX_DATAGRAM];
+    socket.setReceiveTimeout(Poco::Timespan(0, 100000));
+    while (running) {
+        try {
+            Poco::Net::SocketAddress sender;
+            int received = socket.receiveFrom(datagram, sizeof(datagram), sender);
+            UdpChannel::PacketType type;
+            const uint8_t* payload = nullptr;
+            size_t length = 0;
+            if (received <= 0 || !channel.open(datagram, received, type, payload, length)) continue;
+            if (type == UdpChannel::UDP_PROBE) {
+                uint8_t ack[UdpChannel::OVERHEAD];
+                size_t size = channel.seal(UdpChannel::UDP_PROBE_ACK, nullptr, 0, ack, sizeof(ack));
+                socket.sendTo(ack, static_cast<int>(size), sender);
+            }
+            else if (type == UdpChannel::UDP_DATA) {
+                delivered.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        catch (const Poco::Exception&) {
+            // Timeout: check `running` again.
+        }
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    unsigned long packets = 100000;
+    size_t size = 1400;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--packets") == 0) packets = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--size") == 0) size = std::strtoul(argv[i + 1], nullptr, 10);
+    }
+    if (size > UdpChannel::MAX_PAYLOAD) size = UdpChannel::MAX_PAYLOAD;
+
+    try {
+        Poco::Net::DatagramSocket serverSocket(Poco::Net::SocketAddress("127.0.0.1", 0));
+        UdpChannelParams params = UdpChannelParams::generate(serverSocket.address().port(), AeadCipher::AES_256_GCM);
+        UdpChannel serverEnd(params, RekeyingCipher::SERVER);
+        UdpChannel clientEnd(params, RekeyingCipher::CLIENT);
+
+        std::atomic<bool> running(true);
+        std::atomic<unsigned long> delivered(0);
+        std::thread responder(respond, std::ref(serverSocket), std::ref(serverEnd), std::ref(running), std::ref(delivered));
+
+        Poco::Net::DatagramSocket clientSocket;
+        clientSocket.connect(Poco::Net::SocketAddress("127.0.0.1", params.port));
+        Clock::time_point start = Clock::now();
+        bool reachable = clientEnd.probe(clientSocket, 3, Poco::Timespan(0, 200000));
+        double probeMs = millisSince(start);
+
+        std::vector<uint8_t> payload(size, 0x5a);
+        unsigned long sent = 0;
+        start = Clock::now();
+        for (unsigned long i = 0; reachable && i < packets; ++i) {
+            if (clientEnd.send(clientSocket, UdpChannel::UDP_DATA, payload.data(), payload.size())) ++sent;
+        }
+        double sendMs = millisSince(start);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200)); // Let the responder drain its queue.
+        running = false;
+        responder.join();
+
+        // A port that was just released: nothing answers, so the client has to fall back.
+        uint16_t closedPort = 0;
+        {
+            Poco::Net::DatagramSocket probeTarget(Poco::Net::SocketAddress("127.0.0.1", 0));
+            closedPort = probeTarget.address().port();
+        }
+        UdpChannel blockedEnd(params, RekeyingCipher::CLIENT);
+        Poco::Net::DatagramSocket blockedSocket;
+        blockedSocket.connect(Poco::Net::SocketAddress("127.0.0.1", closedPort));
+        start = Clock::now();
+        bool blockedReachable = blockedEnd.probe(blockedSocket, 3, Poco::Timespan(0, 200000));
+        double fallbackMs = millisSince(start);
+
+        double seconds = sendMs / 1000.0;
+        std::printf("{\n  \"benchmark\": \"vpn_udp_bench\",\n  \"project\": \"%s\",\n", VPN_PROJECT);
+        std::printf("  \"probe\": {\"reachable\": %s, \"ms\": %.3f},\n", reachable ? "true" : "false", probeMs);
+        std::printf("  \"burst\": {\"size\": %zu, \"sent\": %lu, \"delivered\": %lu, \"loss\": %.4f, "
+                    "\"packets_per_s\": %.0f, \"mb_per_s\": %.1f},\n",
+                    size, sent, delivered.load(), sent ? 1.0 - double(delivered.load()) / sent : 0.0,
+                    seconds > 0 ? sent / seconds : 0.0, seconds > 0 ? sent * size / seconds / 1e6 : 0.0);
+        std::printf("  \"fallback\": {\"udp_reachable\": %s, \"ms\": %.3f}\n}\n",
+                    blockedReachable ? "true" : "false", fallbackMs);
+        return reachable && !blockedReachable ? 0 : 1;
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "vpn_udp_bench: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "NonceManager.h"
+#include "ReplayWindow.h"
+#include <cstddef>
+#include <cstdint>
+
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+// One entry of an encryptBatch/decryptBatch call. `buffer` uses the AeadCipher packet layout.
+struct AeadPacket {
+    uint8_t* buffer;
+    size_t capacity;   // Bytes available at `buffer` (only read by encryptBatch).
+    size_t length;     // In: payload length (encrypt) or sealed length (decrypt). Out: the result.
+    uint64_t sequence; // Out: packet counter carried in the header.
+    bool ok;           // Out: whether this packet was processed successfully.
+};
+
+// In-place AEAD for the tunnel hot path, next to the vector-based `Encryption` API.
+// Packets live in caller-owned buffers laid out as
+//
+//     [ packet counter (HEADROOM) | payload | tag (TAG_SIZE) ]
+//
+// so encrypting and decrypting never touch the heap. The key schedule is set up once
+// in the constructor; each packet only loads a new nonce into the existing context.
+// Nonces come from a NonceManager per direction, so only the 8-byte counter is sent.
+// Received counters pass a ReplayWindow before any decryption work is done.
+// An instance is not thread-safe; use one per connection and thread.
+class AeadCipher {
+public:
+    enum Algorithm {
+        AES_256_GCM,
+        CHACHA20_POLY1305
+    };
+
+    static const size_t KEY_SIZE = 32;
+    static const size_t NONCE_SIZE = NonceManager::NONCE_SIZE;
+    static const size_t SALT_SIZE = NonceManager::SALT_SIZE;
+    static const size_t TAG_SIZE = 16;
+    static const size_t HEADROOM = NonceManager::EXPLICIT_SIZE; // Bytes the caller reserves in front of the payload.
+    static const size_t OVERHEAD = HEADROOM + TAG_SIZE; // Total growth of a sealed packet.
+
+    // key - KEY_SIZE bytes of key material.
+    // sendSalt/receiveSalt - SALT_SIZE bytes each; the peer uses the same two salts swapped.
+    // Throws std::runtime_error if the cipher cannot be set up.
+    AeadCipher(Algorithm algorithm, const uint8_t* key, const uint8_t* sendSalt, const uint8_t* receiveSalt);
+    ~AeadCipher();
+
+    AeadCipher(const AeadCipher&) = delete;
+    AeadCipher& operator=(const AeadCipher&) = delete;
+
+    Algorithm algorithm() const { return algorithm_; }
+    static const char* algorithmName(Algorithm algorithm);
+
+    // Packet API. The payload is expected at buffer + HEADROOM and `capacity` must leave
+    // room for OVERHEAD. Returns the sealed length, or 0 if the buffer is too small
+    // or the nonce counter is exhausted.
+    size_t encrypt(uint8_t* buffer, size_t capacity, size_t payloadLength);
+
+    // Authenticates and decrypts a sealed packet in place. On success the plaintext
+    // starts at buffer + HEADROOM, `payloadLength` holds its size and `sequence`
+    // (if given) the packet counter the peer sent it with. Replayed packets and packets
+    // older than the replay window are rejected without being decrypted.
+    bool decrypt(uint8_t* buffer, size_t sealedLength, size_t& payloadLength, uint64_t* sequence = nullptr);
+
+    // Packets sealed so far in this session.
+    uint64_t packetsSent() const { return sendNonces_.used(); }
+
+    // Convenience loop over encrypt/decrypt for `count` packets, e.g. everything drained
+    // from a socket in one wakeup. Nothing is shared between the packets beyond what a
+    // single call already reuses; the only extra is prefetching the next packet's buffer.
+    // Packets are independent: a failure only clears that packet's `ok` flag.
+    // Returns the number of packets that succeeded.
+    size_t encryptBatch(AeadPacket* packets, size_t count);
+    size_t decryptBatch(AeadPacket* packets, size_t count);
+
+    // Raw primitives: `data` is overwritten with the result, `tag` is TAG_SIZE bytes.
+    bool seal(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+              uint8_t* data, size_t length, uint8_t* tag);
+    bool open(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+              uint8_t* data, size_t length, const uint8_t* tag);
+
+private:
+    Algorithm algorithm_;
+    EVP_CIPHER_CTX* encryptCtx_;
+    EVP_CIPHER_CTX* decryptCtx_;
+    NonceManager sendNonces_;
+    NonceManager receiveNonces_;
+    ReplayWindow replayWindow_;
+};
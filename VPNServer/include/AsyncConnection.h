@@ -0,0 +1,124 @@
+#pragma once
+#include "EventLoop.h"
+#include "Framing.h"
+#include <Poco/Net/SecureStreamSocket.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A framed TLS connection driven by an EventLoop instead of a dedicated thread.
+//
+// The socket is switched to non-blocking mode. The loop reads whenever it is readable
+// and hands every complete frame to the frame handler; sends from any thread are
+// queued and written when the socket takes them, small frames batched into records of
+// up to MAX_RECORD bytes. Handlers and completions run on the loop thread and must not
+// block. TLS may need to write while reading (and the reverse); both directions retry
+// whenever the socket becomes ready.
+//
+// When the loop runs on io_uring and kernel TLS took over both directions, the socket
+// carries plaintext after the handshake and the connection switches to completions: one
+// multishot receive from the ring's provided buffers, and queued records go out as a
+// chain of linked sends. A TLS control record (key update, alert) sends it back to
+// OpenSSL and readiness for good.
+class AsyncConnection : public std::enable_shared_from_this<AsyncConnection> {
+public:
+    typedef std::shared_ptr<AsyncConnection> Ptr;
+    // `frame` is only valid during the call.
+    typedef std::function<void(const FrameView& frame)> FrameHandler;
+    typedef std::function<void()> CloseHandler;
+    // true once the bytes were handed to TLS, false if the connection closed first.
+    typedef std::function<void(bool ok)> Completion;
+
+    static const size_t MAX_RECORD = 16 * 1024;
+    static const size_t MAX_LINKED = 8;    // Records per chain of linked sends.
+
+    static Ptr create(EventLoop& loop, const Poco::Net::SecureStreamSocket& socket,
+                      FrameHandler onFrame, CloseHandler onClose);
+
+    // Registers with the loop and starts reading (and, for a server socket, the handshake).
+    void start();
+
+    // Queues one frame; safe from any thread. Returns false if the connection is closed
+    // or the payload too large, in which case `done` is not called.
+    bool sendFrame(FrameType type, uint8_t flags, const uint8_t* payload, size_t length,
+                   Completion done = Completion());
+    // Queues bytes that already hold complete frames.
+    bool sendBytes(std::vector<uint8_t> bytes, Completion done = Completion());
+
+    // Closes the connection from any thread once everything queued so far is written.
+    // The close handler runs once, on the loop.
+    void close();
+    bool closed() const { return closed_; }
+
+    Poco::Net::SecureStreamSocket& socket() { return socket_; }
+    EventLoop& loop() { return loop_; }
+
+private:
+    struct Pending {
+        std::vector<uint8_t> bytes;
+        Completion done;
+    };
+    // One record of a linked send chain.
+    struct Batch {
+        Batch() : offset(0) {}
+
+        std::vector<uint8_t> bytes;
+        size_t offset;
+        std::vector<Completion> done;
+    };
+
+    AsyncConnection(EventLoop& loop, const Poco::Net::SecureStreamSocket& socket,
+                    FrameHandler onFrame, CloseHandler onClose);
+
+    void onEvents(int events);
+    void readSome();
+    void writeSome();
+    void scheduleWrite();
+    void updateInterest();
+    // Hands the buffered frames to the frame handler. Returns false if the connection closed.
+    bool dispatchFrames();
+    void fail();
+
+    void maybeUseRing();
+    void leaveRing();
+    void releaseRing();
+    void onRingReceive(const IoUring::Completion& completion);
+    void onRingSend(const IoUring::Completion& completion);
+    void submitSends();
+
+    EventLoop& loop_;
+    Poco::Net::SecureStreamSocket socket_;
+    FrameHandler onFrame_;
+    CloseHandler onClose_;
+    FrameParser parser_;
+
+    std::mutex outboxMutex_;
+    std::deque<Pending> outbox_;
+    std::atomic<bool> writeScheduled_;
+    std::atomic<bool> closing_;
+
+    // Loop thread only.
+    std::vector<uint8_t> writing_;           // Batch being written; kept in place for TLS retries.
+    size_t writingOffset_;
+    std::vector<Completion> writingDone_;
+    bool readWantsWrite_;
+    bool writeWantsRead_;
+    bool writeBlocked_;
+    bool registered_;
+    int interest_;
+    bool ringChecked_;
+    bool ringMode_;
+    bool receiveArmed_;
+    uint64_t receiveUserData_;
+    uint64_t sendUserData_;
+    std::deque<Batch> sending_;              // Chain the kernel is sending from.
+    size_t sendsInFlight_;
+    size_t sendCursor_;                      // Batch the next send completion belongs to.
+    bool sendFailed_;
+    std::atomic<bool> closed_;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include "AeadCipher.h"
+#include <Poco/Net/Context.h>
+#include <string>
+
+// Instruction-set extensions that decide how fast each AEAD runs on this machine.
+struct CpuFeatures {
+    bool aesni = false;      // AES-NI (x86) or the ARMv8 AES instructions
+    bool pclmul = false;     // Carry-less multiply used by GHASH
+    bool avx2 = false;
+    bool avx512f = false;
+    bool vaes = false;       // Vector AES (AES on YMM/ZMM registers)
+    bool vpclmulqdq = false;
+
+    static CpuFeatures detect();
+    std::string toString() const;
+};
+
+// Picks the app-layer AEAD and orders the TLS cipher suites by measured speed.
+// The first call to instance() detects the CPU features and runs a short
+// self-benchmark of AES-256-GCM against ChaCha20-Poly1305; the result is cached
+// for the rest of the process, so call it once during startup.
+class CipherSelector {
+public:
+    static const CipherSelector& instance();
+
+    const CpuFeatures& cpuFeatures() const { return features_; }
+    AeadCipher::Algorithm preferredAead() const { return preferred_; }
+    double aesGcmMBps() const { return aesGcmMBps_; }
+    double chachaMBps() const { return chachaMBps_; }
+
+    // TLS 1.2 cipher list for the Poco::Net::Context constructor, fastest AEAD first.
+    const std::string& tlsCipherList() const { return tlsCipherList_; }
+    // TLS 1.3 cipher suites in the same order.
+    const std::string& tlsCipherSuites() const { return tlsCipherSuites_; }
+
+    // Installs the TLS 1.3 suite order on a context (the 1.2 list goes through the constructor).
+    // Server contexts are also told to honour the server's order. Returns false if OpenSSL
+    // rejected the list; the context then uses OpenSSL's default TLS 1.3 order, not ours.
+    bool applyTo(Poco::Net::Context& context) const;
+
+    std::string describe() const;
+
+private:
+    CipherSelector();
+
+    CpuFeatures features_;
+    AeadCipher::Algorithm preferred_;
+    double aesGcmMBps_;
+    double chachaMBps_;
+    std::string tlsCipherList_;
+    std::string tlsCipherSuites_;
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include <Poco/Net/Context.h>
+#include <cstddef>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Everything that goes into building a Poco::Net::Context. Two connections with the
+// same configuration can share one context.
+struct ContextConfig {
+    ContextConfig()
+        : usage(Poco::Net::Context::CLIENT_USE)
+        , verificationMode(Poco::Net::Context::VERIFY_RELAXED)
+        , verificationDepth(9)
+        , loadDefaultCAs(true) {}
+
+    static ContextConfig client();
+    static ContextConfig server(const std::string& certificateFile, const std::string& privateKeyFile,
+                                const std::string& caLocation);
+
+    Poco::Net::Context::Usage usage;
+    std::string privateKeyFile;
+    std::string certificateFile;
+    std::string caLocation;
+    Poco::Net::Context::VerificationMode verificationMode;
+    int verificationDepth;
+    bool loadDefaultCAs;
+
+    bool operator<(const ContextConfig& other) const;
+    std::string toString() const;
+};
+
+// Process-wide cache of SSL contexts, keyed by ContextConfig.
+//
+// Building a context loads the CA bundle and parses the cipher list, which is most of
+// the cost of a reconnect. get() builds each configuration once and hands the same
+// context to every later connection. Contexts are reference counted, so reload()
+// swaps in a fresh one atomically: new connections pick it up, connections already
+// open keep the one they were made with until they close.
+class ContextCache {
+public:
+    static ContextCache& instance();
+
+    // The cached context for `config`, built on first use. Throws what the
+    // Poco::Net::Context constructor throws (missing or unreadable files).
+    Poco::Net::Context::Ptr get(const ContextConfig& config);
+
+    // Builds a new context for `config` and replaces the cached one. If the build fails
+    // the old context stays in place and false is returned.
+    bool reload(const ContextConfig& config);
+
+    // reload() if the certificate, key or CA file changed since the context was built.
+    // Cheap enough to call on every accept timeout: it only stat()s the files.
+    bool reloadIfChanged(const ContextConfig& config);
+
+    void clear();
+
+    // Contexts built so far, including reloads.
+    size_t builds() const;
+
+private:
+    struct Entry {
+        Poco::Net::Context::Ptr context;
+        std::vector<time_t> stamps;    // Modification times of the files it was built from.
+    };
+
+    ContextCache();
+    ContextCache(const ContextCache&) = delete;
+    ContextCache& operator=(const ContextCache&) = delete;
+
+    static Poco::Net::Context::Ptr build(const ContextConfig& config);
+    static std::vector<time_t> stamps(const ContextConfig& config);
+
+    mutable std::mutex mutex_;
+    std::map<ContextConfig, Entry> entries_;
+    size_t builds_;
+};
@@ -0,0 +1,19 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <Poco/Crypto/Cipher.h>
+
+// Per-connection counterpart of Encryption. The AES-256-CBC key is derived from the
+// passphrase once, in the constructor, and the cipher is reused for every packet.
+// Output is interchangeable with Encryption::encrypt/decrypt for the same key.
+class EncryptionSession {
+public:
+    explicit EncryptionSession(const std::string& key);
+
+    std::vector<uint8_t> encrypt(const std::vector<uint8_t>& data) const;
+    std::vector<uint8_t> decrypt(const std::vector<uint8_t>& data) const;
+
+private:
+    Poco::Crypto::Cipher::Ptr cipher_;
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Message types carried on the TLS stream.
+enum FrameType : uint8_t {
+    FRAME_HELLO = 0x01,  // Protection mode offer/reply (ProtectionNegotiation message).
+    FRAME_DATA = 0x02,   // Tunnel payload.
+    FRAME_PING = 0x03,   // Keep-alive request.
+    FRAME_PONG = 0x04,   // Keep-alive response.
+    FRAME_UDP_REQUEST = 0x05,  // Client asks for a UDP data channel.
+    FRAME_UDP_PARAMS = 0x06,   // Server answer: UdpChannelParams, or empty if UDP is off.
+    FRAME_STREAM_OPEN = 0x07,    // StreamMux: a new logical stream.
+    FRAME_STREAM_DATA = 0x08,    // StreamMux: bytes on one stream.
+    FRAME_STREAM_CREDIT = 0x09,  // StreamMux: the receiver consumed bytes; more may be sent.
+    FRAME_STREAM_CLOSE = 0x0A    // StreamMux: end of one direction, or a reset.
+};
+
+// A parsed frame. `payload` points into the parser's buffer (no copy) and stays valid
+// until the parser is given more bytes.
+struct FrameView {
+    FrameType type;
+    uint8_t flags;
+    const uint8_t* payload;
+    size_t length;
+};
+
+// Wire format of one frame:
+//
+//     [ type (1) | flags (1) | payload length (2, big-endian) | payload ]
+//
+// Frames are self-delimiting, so any number of them can share one TLS record or one
+// read, and a frame may be split across reads. Unknown flag bits are ignored.
+class Framing {
+public:
+    static const size_t HEADER_SIZE = 4;
+    static const size_t MAX_PAYLOAD = 0xFFFF;
+
+    // Writes a frame header for a payload the caller places right after it.
+    static void writeHeader(FrameType type, uint8_t flags, size_t length, uint8_t* out);
+
+    // Writes header and payload to `out`. Returns the frame size, or 0 if the payload
+    // is too large or `capacity` too small.
+    static size_t encode(FrameType type, uint8_t flags, const uint8_t* payload, size_t length,
+                         uint8_t* out, size_t capacity);
+
+    // Appends a frame to `out`, e.g. to batch several small frames into one write.
+    static bool append(std::vector<uint8_t>& out, FrameType type, uint8_t flags,
+                       const uint8_t* payload, size_t length);
+};
+
+// Incremental parser for a stream of frames.
+//
+// Socket reads go straight into the parser (writeBuffer()/commit()); next() then hands
+// out every complete frame as a view into that buffer. A frame cut off at the end of a
+// read is kept and completed by the following reads.
+class FrameParser {
+public:
+    enum Result {
+        FRAME,      // `frame` holds the next frame.
+        NEED_MORE,  // No complete frame buffered; read more.
+        INVALID     // Unknown frame type or a payload over the limit; the stream is unusable.
+    };
+
+    static const size_t INITIAL_CAPACITY = 16 * 1024;
+
+    // maxPayload - Largest payload accepted, at most Framing::MAX_PAYLOAD.
+    explicit FrameParser(size_t maxPayload = Framing::MAX_PAYLOAD);
+
+    // Space for the next read, writable() bytes long. Invalidates the views handed out so far.
+    uint8_t* writeBuffer();
+    size_t writable() const { return buffer_.size() - buffered(); }
+    // Marks `length` bytes of the write buffer as received.
+    void commit(size_t length);
+
+    // Copies `length` bytes in, for data that did not come from writeBuffer().
+    void feed(const uint8_t* data, size_t length);
+
+    Result next(FrameView& frame);
+
+    // Bytes received but not yet returned as frames.
+    size_t buffered() const { return end_ - begin_; }
+
+private:
+    void compact();
+
+    std::vector<uint8_t> buffer_;
+    size_t begin_;
+    size_t end_;
+    size_t maxPayload_;
+};
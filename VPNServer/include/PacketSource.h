@@ -0,0 +1,141 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Room for up to capacity() packets, read in one go into one contiguous block of
+// fixed-size slots. Allocated once and reused for every read.
+class PacketBatch {
+public:
+    static const size_t DEFAULT_CAPACITY = 64;
+    static const size_t DEFAULT_SLOT_SIZE = 2048;    // A 1500-byte MTU with room to spare.
+
+    explicit PacketBatch(size_t capacity = DEFAULT_CAPACITY, size_t slotSize = DEFAULT_SLOT_SIZE);
+
+    size_t size() const { return count_; }
+    size_t capacity() const { return lengths_.size(); }
+    size_t slotSize() const { return slotSize_; }
+    bool full() const { return count_ == lengths_.size(); }
+    void clear() { count_ = 0; }
+
+    const uint8_t* data(size_t i) const { return &storage_[i * slotSize_]; }
+    size_t length(size_t i) const { return lengths_[i]; }
+
+    // For sources: fill the next free slot (slotSize() bytes), then commit its length.
+    uint8_t* nextSlot() { return &storage_[count_ * slotSize_]; }
+    void commit(size_t length) { lengths_[count_++] = length; }
+
+private:
+    std::vector<uint8_t> storage_;
+    std::vector<size_t> lengths_;
+    size_t slotSize_;
+    size_t count_;
+};
+
+// Where the tunnel's IP packets come from and where the ones from the peer go: a TUN
+// device on a real system, memory in tests and benchmarks. Reads are batched: one
+// readBatch() returns everything that is ready, up to a full batch.
+class PacketSource {
+public:
+    virtual ~PacketSource() {}
+
+    // Appends the packets that are ready, waiting up to `timeoutMs` for the first one.
+    // Returns how many were appended: 0 on timeout, -1 once the source is closed.
+    virtual int readBatch(PacketBatch& batch, int timeoutMs) = 0;
+    // Delivers one packet from the peer. Safe from any thread; false if it was dropped.
+    virtual bool write(const uint8_t* packet, size_t length) = 0;
+    // Makes readBatch() return -1 from now on; safe from any thread.
+    virtual void close() = 0;
+    // For logs: the interface name, or "memory".
+    virtual std::string name() const = 0;
+};
+
+// Packets in memory: inject() queues packets for readBatch(), and written packets are
+// kept for take() or only counted. Runs the data plane, and benchmarks it, without a
+// TUN device or CAP_NET_ADMIN.
+class MemoryPacketSource : public PacketSource {
+public:
+    static const size_t DEFAULT_MAX_QUEUED = 4096;
+
+    // keepWritten - Keep written packets for take(); false only counts them.
+    // maxQueued - inject() waits while this many packets are waiting to be read.
+    explicit MemoryPacketSource(bool keepWritten = true, size_t maxQueued = DEFAULT_MAX_QUEUED);
+
+    // Queues one packet for readBatch(). Returns false once the source is closed.
+    bool inject(const uint8_t* packet, size_t length);
+
+    // Packets written so far, in order; they are removed from the source.
+    std::vector<std::vector<uint8_t>> take();
+    uint64_t writtenPackets() const { return writtenPackets_; }
+    uint64_t writtenBytes() const { return writtenBytes_; }
+    // Waits until `packets` packets have been written in total, or `timeoutMs` passed.
+    bool waitWritten(uint64_t packets, int timeoutMs);
+
+    int readBatch(PacketBatch& batch, int timeoutMs) override;
+    bool write(const uint8_t* packet, size_t length) override;
+    void close() override;
+    std::string name() const override { return "memory"; }
+
+private:
+    bool keepWritten_;
+    size_t maxQueued_;
+    std::mutex mutex_;
+    std::condition_variable readable_;       // Packets were injected, or closed.
+    std::condition_variable writable_;       // The inbound queue has room again.
+    std::condition_variable written_;
+    std::deque<std::vector<uint8_t>> inbound_;
+    std::vector<std::vector<uint8_t>> outbound_;
+    std::atomic<uint64_t> writtenPackets_;
+    std::atomic<uint64_t> writtenBytes_;
+    bool closed_;
+};
+
+// The queues of one multi-queue device, each read by its own worker thread.
+//
+// Packets are written to the queue their flow hashes to (IpPacket::flowHash), so every
+// packet of a flow, in both directions, is handled by one queue and one worker: no
+// reordering within a flow, and its state stays in one core's cache. A single source
+// is a one-queue group.
+class PacketQueues {
+public:
+    PacketQueues() {}
+    explicit PacketQueues(std::vector<std::shared_ptr<PacketSource>> queues);
+
+    size_t size() const { return queues_.size(); }
+    bool empty() const { return queues_.empty(); }
+    PacketSource& queue(size_t i) { return *queues_[i]; }
+    // The queue the flow of `packet` belongs to; non-IP packets go to the first one.
+    PacketSource& queueFor(const uint8_t* packet, size_t length);
+
+    // Writes `packet` to the queue of its flow.
+    bool write(const uint8_t* packet, size_t length);
+    // Closes every queue.
+    void close();
+    std::string name() const;
+
+    // Pins the calling worker to core `index` modulo the core count (Linux, best effort),
+    // so queue i's packets are always processed on one core.
+    static bool pinToCore(size_t index);
+
+private:
+    std::vector<std::shared_ptr<PacketSource>> queues_;
+};
+
+// Header fields of a raw IPv4 or IPv6 packet, as a TUN device hands them out.
+// Addresses are kept as their 4 or 16 raw bytes, ready to be used as map keys.
+struct IpPacket {
+    // False if `packet` is too short or neither IPv4 nor IPv6.
+    static bool sourceAddress(const uint8_t* packet, size_t length, std::string& address);
+    static bool destinationAddress(const uint8_t* packet, size_t length, std::string& address);
+    // Hash of addresses, protocol and (TCP/UDP) ports. Symmetric: both directions of a
+    // flow get the same value. Non-IP packets hash to 0.
+    static uint32_t flowHash(const uint8_t* packet, size_t length);
+    // Dotted or colon notation, for logs.
+    static std::string toString(const std::string& address);
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// How tunnel payloads are protected on a connection. Modes are bit flags so a
+// client can offer several at once.
+enum ProtectionMode : uint8_t {
+    PROTECTION_NONE = 0x00,
+    PROTECTION_DOUBLE = 0x01,    // Inner `Encryption` layer inside TLS (the original behaviour).
+    PROTECTION_TLS_ONLY = 0x02,  // The TLS record layer is the only protection.
+    PROTECTION_AEAD_ONLY = 0x04  // The inner AEAD is the only protection (plain or UDP transport).
+};
+
+// Picks one protection mode per connection right after the TLS handshake.
+//
+// The client sends an offer with every mode it can run; the server answers with the
+// one it picked, preferring a single layer of encryption over two. Both messages are
+// MESSAGE_SIZE bytes: a 3-byte magic followed by the mode byte(s).
+class ProtectionNegotiation {
+public:
+    static const size_t MESSAGE_SIZE = 4;
+
+    static std::vector<uint8_t> offer(uint8_t modes);
+    static bool parseOffer(const uint8_t* data, size_t length, uint8_t& modes);
+
+    static std::vector<uint8_t> reply(ProtectionMode mode);
+    static bool parseReply(const uint8_t* data, size_t length, ProtectionMode& mode);
+
+    // Returns the preferred mode present in both masks, or PROTECTION_NONE.
+    static ProtectionMode choose(uint8_t offered, uint8_t supported);
+
+    static const char* name(ProtectionMode mode);
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Sliding anti-replay window over received packet counters.
+//
+// The bitmap is a ring of 64-bit words (RFC 6479): moving the window forward clears
+// whole words instead of shifting the bitmap, so both check() and update() are O(1)
+// no matter how far packets are reordered. Counters up to WINDOW_SIZE behind the
+// highest one seen are tracked; anything older is rejected.
+//
+// check() runs before the packet is decrypted; update() only after it authenticated,
+// so forged packets can never move the window.
+class ReplayWindow {
+public:
+    static const size_t BITMAP_BITS = 4096;
+    static const size_t WORD_BITS = 64;
+    static const size_t WORDS = BITMAP_BITS / WORD_BITS;
+    static const uint64_t WINDOW_SIZE = BITMAP_BITS - WORD_BITS; // One word is always being recycled.
+
+    ReplayWindow();
+
+    // Returns true if `counter` has not been seen and is still inside the window.
+    bool check(uint64_t counter) const;
+
+    // Marks `counter` as received, advancing the window if it is the newest so far.
+    void update(uint64_t counter);
+
+    uint64_t highest() const { return highest_; }
+
+private:
+    uint64_t bitmap_[WORDS];
+    uint64_t highest_;
+};
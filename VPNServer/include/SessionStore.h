@@ -0,0 +1,67 @@
+#pragma once
+#include <Poco/Net/Session.h>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Small memory-mapped file that keeps the latest TLS session ticket and the resolved
+// address of each server endpoint across client restarts.
+//
+// A freshly started client finds both in the file: it connects without a DNS lookup
+// and resumes the TLS session, so the first connection after an upgrade costs one
+// round trip instead of a lookup plus a full handshake. SessionCache reads and writes
+// through the store when one is attached.
+//
+// The file holds SLOTS fixed-size slots; the least recently saved endpoint is evicted.
+// Each slot carries a checksum, so a slot torn by a crash or a concurrent writer is
+// treated as empty. Tickets are resumption secrets: the file is created with mode 0600.
+class SessionStore {
+public:
+    static const size_t SLOTS = 16;
+    static const size_t ENDPOINT_CAPACITY = 96;   // "host:port", NUL-terminated.
+    static const size_t ADDRESS_CAPACITY = 64;    // Numeric "ip:port" or "[ip6]:port".
+    static const size_t TICKET_CAPACITY = 4096;   // DER-encoded SSL_SESSION.
+
+    // Opens or creates the store at `path`. Throws std::runtime_error if the file cannot
+    // be created or mapped; a file with a foreign layout is reset.
+    explicit SessionStore(const std::string& path);
+    ~SessionStore();
+
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+
+    // $VPN_SESSION_STORE, else ~/.vpn_client_sessions.
+    static std::string defaultPath();
+
+    // The saved session for `endpoint`, or null if there is none or it has expired.
+    Poco::Net::Session::Ptr loadSession(const std::string& endpoint);
+    // Saves `session`, or clears the saved ticket if it is null or too large.
+    bool saveSession(const std::string& endpoint, Poco::Net::Session::Ptr session);
+
+    // The saved numeric address for `endpoint`, or an empty string.
+    std::string loadAddress(const std::string& endpoint);
+    bool saveAddress(const std::string& endpoint, const std::string& address);
+
+    void remove(const std::string& endpoint);
+
+    const std::string& path() const { return path_; }
+
+private:
+    struct Header;
+    struct Slot;
+
+    Slot* slots();
+    Slot* findLocked(const std::string& endpoint);
+    Slot* claimLocked(const std::string& endpoint);
+    void sealLocked(Slot& slot);
+
+    static uint64_t checksum(const Slot& slot);
+    static bool valid(const Slot& slot);
+
+    std::string path_;
+    std::mutex mutex_;
+    int fd_;
+    uint8_t* map_;
+    size_t size_;
+};
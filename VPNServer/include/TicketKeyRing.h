@@ -0,0 +1,74 @@
+#pragma once
+#include <Poco/Net/Context.h>
+#include <openssl/ssl.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Server-side keys for TLS session tickets, rotated on a timer.
+//
+// OpenSSL's default ticket key is random per SSL_CTX, so every context rebuild (or
+// certificate reload) would invalidate all outstanding tickets. The ring is shared by
+// all server contexts of the process instead: new tickets are sealed with the newest
+// key, and tickets sealed with one of the MAX_KEYS - 1 older keys are still accepted
+// (and renewed). Keys are random and never leave memory, so a server restart still
+// forces full handshakes once.
+//
+// Rotation is lazy: the ticket callback starts a new key when the newest one is older
+// than the rotation interval, so no thread is needed.
+class TicketKeyRing {
+public:
+    static const size_t NAME_SIZE = 16;
+    static const size_t KEY_SIZE = 32;
+    static const size_t MAX_KEYS = 3;
+
+    static TicketKeyRing& instance();
+
+    // Makes `context` seal and open tickets with this ring (server contexts only).
+    void install(Poco::Net::Context& context);
+
+    void setRotationInterval(std::chrono::seconds interval);
+    std::chrono::seconds rotationInterval() const;
+    // How long a ticket stays acceptable at least: MAX_KEYS - 1 rotation intervals.
+    std::chrono::seconds ticketLifetime() const;
+
+    // Starts a new key now, for example after a suspected key compromise.
+    bool rotate();
+
+    size_t keys() const;
+    uint64_t issued() const { return issued_; }      // Tickets sealed.
+    uint64_t accepted() const { return accepted_; }  // Tickets presented with a known key.
+    uint64_t unknown() const { return unknown_; }    // Tickets with an expired or foreign key.
+
+private:
+    struct Key {
+        Key();
+        ~Key();
+        Key(const Key& other);
+        Key& operator=(const Key& other);
+
+        uint8_t name[NAME_SIZE];
+        uint8_t aesKey[KEY_SIZE];
+        uint8_t hmacKey[KEY_SIZE];
+        std::chrono::steady_clock::time_point created;
+    };
+
+    TicketKeyRing();
+    TicketKeyRing(const TicketKeyRing&) = delete;
+    TicketKeyRing& operator=(const TicketKeyRing&) = delete;
+
+    static int callback(SSL* ssl, unsigned char* name, unsigned char* iv,
+                        EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int encrypt);
+    int handle(unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int encrypt);
+    bool rotateLocked(std::chrono::steady_clock::time_point now);
+
+    mutable std::mutex mutex_;
+    std::vector<Key> keys_;    // Newest first.
+    std::chrono::seconds interval_;
+    std::atomic<uint64_t> issued_;
+    std::atomic<uint64_t> accepted_;
+    std::atomic<uint64_t> unknown_;
+};
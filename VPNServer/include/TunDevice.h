@@ -0,0 +1,46 @@
+#pragma once
+#include "PacketSource.h"
+#include <string>
+
+// A Linux TUN interface opened without packet information (IFF_TUN | IFF_NO_PI): every
+// read() returns one IP packet and every write() injects one.
+//
+// Opening one needs CAP_NET_ADMIN, or a persistent device created for the user
+// (`ip tuntap add dev tun0 mode tun user $USER`). Addresses, MTU and routes of the
+// interface are left to the system (`ip addr`, `ip link`, `ip route`). The MTU has to
+// stay below the slot size of the batches read from it, or packets are cut short.
+//
+// With IFF_MULTI_QUEUE every TunDevice is one queue of the interface. The kernel hands
+// all packets of a flow to the same queue, so one worker thread per queue reads them
+// in order; see openQueues(). A persistent device has to be created as multi-queue
+// (`ip tuntap add ... multi_queue`) for that.
+class TunDevice : public PacketSource {
+public:
+    static const unsigned MAX_QUEUES = 256;    // The kernel's limit per interface.
+
+    // Opens (or creates) interface `name`; an empty name lets the kernel pick tunN.
+    // `multiQueue` attaches one more queue of a multi-queue interface.
+    // Throws std::runtime_error if the device cannot be opened, or off Linux.
+    explicit TunDevice(const std::string& name, bool multiQueue = false);
+
+    // Opens `count` queues of interface `name` (at most MAX_QUEUES), or a plain
+    // single-queue device for a count of 1. Throws std::runtime_error.
+    static PacketQueues openQueues(const std::string& name, unsigned count);
+
+    ~TunDevice() override;
+
+    TunDevice(const TunDevice&) = delete;
+    TunDevice& operator=(const TunDevice&) = delete;
+
+    // One poll() for the first packet, then non-blocking reads until the device is
+    // drained or the batch is full.
+    int readBatch(PacketBatch& batch, int timeoutMs) override;
+    bool write(const uint8_t* packet, size_t length) override;
+    void close() override;
+    std::string name() const override { return name_; }
+
+private:
+    int fd_;
+    int wakeFd_;    // eventfd; close() uses it to end a waiting readBatch().
+    std::string name_;
+};
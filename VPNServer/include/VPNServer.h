@@ -1,25 +1,199 @@
 #pragma once
-#include "Tunnel.h"
-#include "Encryption.h"
-#include <Poco/Net/SecureServerSocket.h>
+#include "AsyncConnection.h"                //Non-blocking framed connection driven by an event loop.
+#include "ContextCache.h"                   //One shared SSL context, rebuilt when the certificates change.
+#include "EncryptionSession.h"              //Inner encryption layer for clients that negotiate it.
+#include "EventLoop.h"                      //Polls many client sockets from one thread.
+#include "Framing.h"                        //Frame format and incremental parser for the TLS stream.
+#include "PacketSource.h"                   //IP packets of the data plane (TUN device or memory).
+#include "StreamMux.h"                      //Logical streams with per-stream flow control.
+#include "UdpChannel.h"                     //Per-packet AEAD datagrams for the UDP data channel.
+#include <Poco/Net/DatagramSocket.h>        //UDP socket shared by all clients' data channels.
+#include <Poco/Net/ServerSocket.h>          //Listening socket; TLS is attached per connection.
+#include <Poco/Net/SocketAddress.h>         //Last address of each client's UDP data channel.
+#include <Poco/Net/SecureStreamSocket.h>    //Provides a stream socket class for secure SSL/TLS connections.
+#include <Poco/Thread.h>                    //Provide thread management classes.
+#include <Poco/Logger.h>
+#include <atomic>                            //Flags read by the loop, packet and UDP threads.
+#include <condition_variable>
+#include <cstdint>
+#include <map>                               //Key-value pair container for managing client connections.
+#include <memory>                            //Provides smart pointers like std::shared_ptr.
+#include <mutex>                             // Provides thread-safety for shared resources.
+#include <shared_mutex>                      //Routes are read by every packet worker at once.
 #include <string>
 #include <thread>
-#include <atomic>
+#include <vector>
 
+class RunnableWrapper;
+
+// Accepts TLS clients on one port and drives their connections from a fixed set of
+// event loops, one per core. Clients may open a UDP data channel on the same port
+// number. With packet queues set (normally a TUN device) the clients' data is carried
+// as IP packets; without, it is only logged.
 class VPNServer {
 public:
-    VPNServer(int port);
+    // Constructor to initialize the server.
+    // encryptionKey - Enables the inner encryption layer for clients that ask for it.
+    // enableUdp - Offers clients a UDP data channel on the same port number.
+    // Throws Poco::Exception if the certificates cannot be loaded or the port is taken.
+    VPNServer(uint16_t port, const std::string& encryptionKey = "", bool enableUdp = true);
     ~VPNServer();
 
+    VPNServer(const VPNServer&) = delete;
+    VPNServer& operator=(const VPNServer&) = delete;
+
+    // Starts accepting clients, the UDP receiver and the packet workers, and returns.
+    // False if the server is already running or could not be started.
     bool start();
+    // Blocks until stop(), looking after the certificate files meanwhile.
+    void waitForStop();
+    // Stops the server and cleans up resources. Safe from any thread.
     void stop();
 
+    // Carries clients' IP packets through `source` (normally a TunDevice) instead of only
+    // logging their data. Call before start().
+    void setPacketSource(std::shared_ptr<PacketSource> source);
+    // Same with the queues of a multi-queue device (TunDevice::openQueues), one worker
+    // thread each. Call before start().
+    void setPacketQueues(PacketQueues queues);
+
+    bool isActive() const { return isRunning; }
+    size_t getConnectedClientsCount() const;
+
 private:
-    void handleClient(Poco::Net::StreamSocket clientSocket);
-    bool authenticateClient(Poco::Net::StreamSocket& clientSocket);
-
-    int port_;
-    Poco::Net::SecureServerSocket* serverSocket_;
-    std::atomic<bool> running_;
-    std::string encryptionKey_;
-};
\ No newline at end of file
+    // Everything one connected client needs; lives as long as its connection.
+    struct Client {
+        std::string id;
+        AsyncConnection::Ptr connection;
+        std::unique_ptr<StreamMux> streams;
+        // Inner encryption layer; clients that skip negotiation keep double encryption.
+        std::shared_ptr<EncryptionSession> session;
+        bool negotiated = false;
+        uint64_t udpSessionId = 0;    // Set if the client opened a UDP data channel.
+    };
+
+    // UDP data channel of one client, found by the session id in each datagram.
+    struct UdpSession {
+        UdpSession(const UdpChannelParams& params, const std::string& clientId,
+                   std::shared_ptr<EncryptionSession> session)
+            : clientId(clientId)
+            , channel(params, RekeyingCipher::SERVER)
+            , session(std::move(session)) {}
+
+        std::string clientId;
+        UdpChannel channel;
+        std::shared_ptr<EncryptionSession> session;    // Inner layer, if the client negotiated one.
+
+        // Guards the sending side of `channel` (probe answers and downlink packets come
+        // from different threads) and `peer`.
+        std::mutex sendMutex;
+        Poco::Net::SocketAddress peer;    // Where the last authenticated datagram came from.
+        bool peerKnown = false;           // No downlink over UDP before the first one.
+    };
+
+    // Where packets for one inner address go. Learned from the source address of the
+    // first packet a client sends from it.
+    struct Route {
+        std::string clientId;
+        AsyncConnection::Ptr connection;
+        std::shared_ptr<EncryptionSession> session;    // Inner layer, if negotiated.
+        std::shared_ptr<UdpSession> udp;    // Preferred for the downlink; null: TCP only.
+    };
+
+    // Protection modes this server accepts. TLS alone is always available; the inner
+    // encryption layer only when a key was configured.
+    uint8_t supportedModes() const;
+    // Wraps an accepted TCP connection in TLS with the current cached context.
+    Poco::Net::SecureStreamSocket secureConnection(const Poco::Net::StreamSocket& socket);
+    // Picks up renewed certificates without a restart. Connections already open keep
+    // the context they were accepted with.
+    void reloadCertificatesIfChanged();
+    // Initializes the logger with a file output channel and formatted messages.
+    static Poco::Logger& initLogger();
+    // Deals connections out to the event loops in turn.
+    EventLoop& nextLoop();
+
+    // Hands an accepted connection to an event loop. Returns at once; everything else
+    // happens in the frame and close handlers on that loop's thread.
+    void handleClient(const Poco::Net::SecureStreamSocket& clientSocket);
+    // Handles one frame from a client, on its event loop.
+    void onFrame(Client& client, const FrameView& frame);
+    // Cleans up after a connection closed for any reason, on its event loop.
+    void onClosed(Client& client);
+    // Answers a protection mode offer. Returns false if the client has to be dropped.
+    bool negotiate(Client& client, const FrameView& frame);
+    // Queues a small control frame (HELLO reply, PONG, UDP parameters) on the connection.
+    static void sendFrame(AsyncConnection& connection, FrameType type,
+                          const uint8_t* payload, size_t length);
+    // Answers a UDP channel request with fresh session parameters, or an empty payload
+    // if UDP is off (the client then keeps all data on TCP). Returns the session id or 0.
+    uint64_t openUdpSession(Client& client);
+    // Receives the datagrams of all UDP data channels.
+    void handleUdp();
+    // UDP data channel of `clientId`, or null. Caller holds udpMutex.
+    std::shared_ptr<UdpSession> findUdpSessionLocked(const std::string& clientId) const;
+    // Sends one downlink packet as a datagram to the address the client last used.
+    // Returns false if the caller has to use TCP: no datagram authenticated yet, the
+    // packet does not fit, or the send failed.
+    bool sendOverUdp(UdpSession& udp, const uint8_t* data, size_t length);
+    // Dispatches one frame received from a client.
+    void handleFrame(Client& client, const FrameView& frame);
+
+    // Processes a data frame from a client.
+    // `session` is the inner encryption layer, or null when TLS is the only one.
+    void handleReceivedData(const std::string& clientId,
+                            const uint8_t* data,
+                            size_t length,
+                            const EncryptionSession* session);
+    // Data of a DATA frame or UDP datagram: one IP packet for the data plane, or just
+    // logged without one. `label` names the client and path in the log.
+    void handleClientData(const std::string& clientId,
+                          const std::string& label,
+                          const uint8_t* data,
+                          size_t length,
+                          const std::shared_ptr<EncryptionSession>& session);
+    // Writes a client's packet into the data plane. Its source address becomes the
+    // client's route; a packet from an address another client owns is dropped.
+    void deliverPacket(const std::string& clientId, const uint8_t* packet, size_t length,
+                       const std::shared_ptr<EncryptionSession>& session);
+    // Whether `address` is routed to `clientId`, claiming it if nobody owns it yet.
+    bool ownsAddress(const std::string& clientId, const std::string& address,
+                     const std::shared_ptr<EncryptionSession>& session);
+    // Worker of one queue: reads its packets a batch at a time and sends each to the
+    // client that owns its destination, over its UDP data channel when that is up and
+    // on its TLS connection otherwise. Packets for unknown addresses are dropped.
+    void handlePackets(size_t queue);
+
+    //Server socket for incoming connections; TLS is attached to each one when accepted.
+    Poco::Net::ServerSocket serverSocket;
+    std::atomic<bool> isRunning;   //Flag to indicate if the server is running; read by every worker thread.
+
+    // Each loop drives its share of the clients from one thread; none of them blocks.
+    std::vector<std::unique_ptr<EventLoop>> eventLoops;
+    size_t nextLoopIndex;          // Accepting loop only.
+    std::mutex stopMutex;
+    std::condition_variable stopRequested;    // Wakes waitForStop() when stop() is called.
+    mutable std::mutex clientsMutex; // Use mutable to allow modification in const methods
+    std::map<std::string, std::shared_ptr<Client>> clients; // Active client connections.
+    Poco::Logger& logger;    //// Logger for logging server events.
+    std::string encryptionKey;    // Passphrase for the inner encryption layer; empty disables it.
+    ContextConfig contextConfig;  // Key of the shared SSL context in ContextCache.
+    uint16_t port;                // TCP port; the UDP data channel uses the same number.
+    bool udpEnabled;              // Whether clients are offered a UDP data channel.
+    Poco::Net::DatagramSocket udpSocket;    // Receives the datagrams of every client.
+    Poco::Thread udpThread;
+    std::unique_ptr<RunnableWrapper> udpReceiver;
+
+    std::mutex udpMutex;
+    std::map<uint64_t, std::shared_ptr<UdpSession>> udpSessions;
+
+    // Data plane: client packets are written into these queues (normally of a TUN
+    // device), each into the queue of its flow, and one worker per queue sends the
+    // packets read from it to the client that owns their destination address.
+    // Empty: data is only logged.
+    PacketQueues packets;
+    std::vector<std::thread> packetWorkers;
+
+    std::shared_mutex routesMutex;
+    std::map<std::string, Route> routes;    // Raw address bytes (IpPacket) to route.
+};
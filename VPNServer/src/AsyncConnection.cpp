@@ -0,0 +1,437 @@
+#include "AsyncConnection.h"
+#include "KernelTls.h"
+#include <Poco/Exception.h>
+#include <cerrno>
+
+AsyncConnection::Ptr AsyncConnection::create(EventLoop& loop, const Poco::Net::SecureStreamSocket& socket,
+                                             FrameHandler onFrame, CloseHandler onClose) {
+    return Ptr(new AsyncConnection(loop, socket, std::move(onFrame), std::move(onClose)));
+}
+
+AsyncConnection::AsyncConnection(EventLoop& loop, const Poco::Net::SecureStreamSocket& socket,
+                                 FrameHandler onFrame, CloseHandler onClose)
+    : loop_(loop)
+    , socket_(socket)
+    , onFrame_(std::move(onFrame))
+    , onClose_(std::move(onClose))
+    , writeScheduled_(false)
+    , closing_(false)
+    , writingOffset_(0)
+    , readWantsWrite_(false)
+    , writeWantsRead_(false)
+    , writeBlocked_(false)
+    , registered_(false)
+    , interest_(0)
+    , ringChecked_(false)
+    , ringMode_(false)
+    , receiveArmed_(false)
+    , receiveUserData_(0)
+    , sendUserData_(0)
+    , sendsInFlight_(0)
+    , sendCursor_(0)
+    , sendFailed_(false)
+    , closed_(false) {
+}
+
+void AsyncConnection::start() {
+    Ptr self = shared_from_this();
+    loop_.post([self]() {
+        if (self->closed_) return;
+        try {
+            self->socket_.setBlocking(false);
+        }
+        catch (const Poco::Exception&) {
+            self->fail();
+            return;
+        }
+        self->interest_ = EventLoop::READABLE;
+        self->loop_.add(self->socket_, self->interest_, [self](int events) { self->onEvents(events); });
+        self->registered_ = true;
+        self->readSome();    // The handshake may already have bytes waiting.
+        self->writeSome();
+    });
+}
+
+bool AsyncConnection::sendFrame(FrameType type, uint8_t flags, const uint8_t* payload, size_t length,
+                                Completion done) {
+    std::vector<uint8_t> bytes;
+    if (!Framing::append(bytes, type, flags, payload, length)) return false;
+    return sendBytes(std::move(bytes), std::move(done));
+}
+
+bool AsyncConnection::sendBytes(std::vector<uint8_t> bytes, Completion done) {
+    {
+        std::lock_guard<std::mutex> lock(outboxMutex_);
+        if (closed_ || closing_) return false;
+        Pending pending;
+        pending.bytes = std::move(bytes);
+        pending.done = std::move(done);
+        outbox_.push_back(std::move(pending));
+    }
+    scheduleWrite();
+    return true;
+}
+
+void AsyncConnection::close() {
+    closing_ = true;
+    Ptr self = shared_from_this();
+    loop_.post([self]() { self->writeSome(); });    // Closes once the outbox is empty.
+}
+
+void AsyncConnection::onEvents(int events) {
+    (void)events;    // TLS decides what each direction needs; just retry both.
+    readSome();
+    writeSome();
+}
+
+void AsyncConnection::readSome() {
+    while (!closed_) {
+        int received = 0;
+        try {
+            received = socket_.receiveBytes(parser_.writeBuffer(), static_cast<int>(parser_.writable()));
+        }
+        catch (const Poco::Exception&) {
+            fail();
+            return;
+        }
+        if (received == Poco::Net::SecureStreamSocket::ERR_SSL_WANT_READ) {
+            readWantsWrite_ = false;
+            break;
+        }
+        if (received == Poco::Net::SecureStreamSocket::ERR_SSL_WANT_WRITE) {
+            readWantsWrite_ = true;
+            break;
+        }
+        if (received <= 0) {    // Peer closed.
+            fail();
+            return;
+        }
+        parser_.commit(static_cast<size_t>(received));
+        if (!dispatchFrames()) return;
+        maybeUseRing();
+        if (ringMode_) return;
+    }
+    updateInterest();
+}
+
+bool AsyncConnection::dispatchFrames() {
+    FrameView frame;
+    FrameParser::Result result;
+    while ((result = parser_.next(frame)) == FrameParser::FRAME) {
+        if (onFrame_) onFrame_(frame);
+        if (closed_) return false;
+    }
+    if (result == FrameParser::INVALID) {
+        fail();
+        return false;
+    }
+    return true;
+}
+
+void AsyncConnection::writeSome() {
+    writeScheduled_ = false;
+    if (ringMode_) {
+        submitSends();
+        return;
+    }
+    if (sendsInFlight_ > 0) return;    // Left the ring mid-chain; the chain's end calls back.
+    while (!closed_) {
+        if (writingOffset_ == writing_.size()) {
+            writing_.clear();
+            writingOffset_ = 0;
+            std::lock_guard<std::mutex> lock(outboxMutex_);
+            // Batch small frames into one record; one large frame goes on its own.
+            while (!outbox_.empty() && (writing_.empty() || writing_.size() + outbox_.front().bytes.size() <= MAX_RECORD)) {
+                Pending& pending = outbox_.front();
+                writing_.insert(writing_.end(), pending.bytes.begin(), pending.bytes.end());
+                if (pending.done) writingDone_.push_back(std::move(pending.done));
+                outbox_.pop_front();
+            }
+            if (writing_.empty()) {
+                // Only empty sends (flush markers): everything before them is written.
+                std::vector<Completion> done;
+                done.swap(writingDone_);
+                for (Completion& completion : done) completion(true);
+                break;
+            }
+        }
+
+        int sent = 0;
+        try {
+            sent = socket_.sendBytes(writing_.data() + writingOffset_, static_cast<int>(writing_.size() - writingOffset_));
+        }
+        catch (const Poco::Exception&) {
+            fail();
+            return;
+        }
+        if (sent == Poco::Net::SecureStreamSocket::ERR_SSL_WANT_WRITE
+            || sent == Poco::Net::SecureStreamSocket::ERR_SSL_WANT_READ) {
+            // Retried later with the same buffer, as TLS requires.
+            writeBlocked_ = true;
+            writeWantsRead_ = sent == Poco::Net::SecureStreamSocket::ERR_SSL_WANT_READ;
+            updateInterest();
+            return;
+        }
+        if (sent <= 0) {
+            fail();
+            return;
+        }
+        writingOffset_ += static_cast<size_t>(sent);
+        if (writingOffset_ == writing_.size()) {
+            std::vector<Completion> done;
+            done.swap(writingDone_);
+            for (Completion& completion : done) completion(true);
+        }
+    }
+    writeBlocked_ = false;
+    writeWantsRead_ = false;
+    if (closing_ && !closed_) {
+        std::lock_guard<std::mutex> lock(outboxMutex_);
+        if (!outbox_.empty()) {
+            scheduleWrite();    // Queued while we were writing.
+            return;
+        }
+    }
+    if (closing_) {
+        fail();
+        return;
+    }
+    updateInterest();
+}
+
+void AsyncConnection::scheduleWrite() {
+    if (writeScheduled_.exchange(true)) return;
+    Ptr self = shared_from_this();
+    loop_.post([self]() { self->writeSome(); });
+}
+
+void AsyncConnection::updateInterest() {
+    if (!registered_ || closed_) return;
+    int interest = EventLoop::READABLE;
+    if ((writeBlocked_ && !writeWantsRead_) || readWantsWrite_) interest |= EventLoop::WRITABLE;
+    if (interest != interest_) {
+        interest_ = interest;
+        loop_.update(socket_, interest);
+    }
+}
+
+void AsyncConnection::fail() {
+    std::deque<Pending> unsent;
+    {
+        std::lock_guard<std::mutex> lock(outboxMutex_);
+        if (closed_) return;
+        closed_ = true;
+        unsent.swap(outbox_);
+    }
+    Ptr self = shared_from_this();    // The loop's handler may hold the last other reference.
+    if (registered_) {
+        loop_.remove(socket_);
+        registered_ = false;
+    }
+    if (receiveArmed_ || sendsInFlight_ > 0) {
+        // The kernel may still read the send buffers; they go once the cancellations complete.
+        loop_.ring()->cancel(receiveUserData_);
+        loop_.ring()->cancel(sendUserData_);
+    }
+    try {
+        socket_.setBlocking(false);    // Blocking in ring mode; the close alert must not wait.
+        socket_.close();
+    }
+    catch (const Poco::Exception&) {
+        // Already gone.
+    }
+
+    std::vector<Completion> done;
+    done.swap(writingDone_);
+    for (Pending& pending : unsent) {
+        if (pending.done) done.push_back(std::move(pending.done));
+    }
+    for (Completion& completion : done) completion(false);
+    releaseRing();
+
+    // Drop the handlers: they usually hold a reference back to whoever owns this connection.
+    CloseHandler onClose;
+    onClose.swap(onClose_);
+    onFrame_ = FrameHandler();
+    if (onClose) onClose();
+}
+
+// Called after every successful read: switches to io_uring completions once the kernel
+// does the TLS record work in both directions and OpenSSL holds nothing back.
+void AsyncConnection::maybeUseRing() {
+    IoUring* ring = loop_.ring();
+    if (ringChecked_ || !ring) return;
+    if (writingOffset_ != writing_.size() || socket_.available() > 0) return;    // Next read.
+    ringChecked_ = true;
+    KernelTls::Status status = KernelTls::status(socket_);
+    if (!status.send || !status.receive) return;
+
+    try {
+        socket_.setBlocking(true);    // io_uring waits for the socket itself; non-blocking would mean -EAGAIN.
+    }
+    catch (const Poco::Exception&) {
+        return;
+    }
+    if (registered_) {
+        loop_.remove(socket_);
+        registered_ = false;
+    }
+    Ptr self = shared_from_this();
+    receiveUserData_ = loop_.addCompletion([self](const IoUring::Completion& completion) {
+        self->onRingReceive(completion);
+    });
+    sendUserData_ = loop_.addCompletion([self](const IoUring::Completion& completion) {
+        self->onRingSend(completion);
+    });
+    ringMode_ = true;
+    ring->receiveMultishot(socket_.impl()->sockfd(), receiveUserData_);
+    receiveArmed_ = true;
+    submitSends();
+}
+
+// Back to OpenSSL and readiness, for good.
+void AsyncConnection::leaveRing() {
+    ringMode_ = false;
+    try {
+        socket_.setBlocking(false);
+    }
+    catch (const Poco::Exception&) {
+        fail();
+        return;
+    }
+    Ptr self = shared_from_this();
+    interest_ = EventLoop::READABLE;
+    loop_.add(socket_, interest_, [self](int events) { self->onEvents(events); });
+    registered_ = true;
+    releaseRing();
+    readSome();    // OpenSSL takes the record the kernel would not hand over as data.
+    writeSome();
+}
+
+// Drops the ring handlers once the kernel is done with this connection.
+void AsyncConnection::releaseRing() {
+    if (receiveUserData_ == 0 || receiveArmed_ || sendsInFlight_ > 0) return;
+    if (ringMode_ && !closed_) return;
+    loop_.removeCompletion(receiveUserData_);
+    loop_.removeCompletion(sendUserData_);
+    receiveUserData_ = 0;
+    sendUserData_ = 0;
+
+    std::vector<Completion> done;
+    for (Batch& batch : sending_) {
+        for (Completion& completion : batch.done) done.push_back(std::move(completion));
+    }
+    sending_.clear();
+    for (Completion& completion : done) completion(false);
+}
+
+void AsyncConnection::onRingReceive(const IoUring::Completion& completion) {
+    IoUring* ring = loop_.ring();
+    if (!completion.more()) receiveArmed_ = false;
+    int buffer = completion.buffer();
+    if (completion.result > 0 && buffer >= 0 && !closed_) {
+        parser_.feed(ring->bufferData(buffer), static_cast<size_t>(completion.result));
+    }
+    if (buffer >= 0) ring->recycleBuffer(buffer);
+    if (closed_) {
+        releaseRing();
+        return;
+    }
+
+    if (completion.result > 0) {
+        if (!dispatchFrames()) return;
+    }
+    else if (completion.result == 0) {    // Peer closed.
+        fail();
+        return;
+    }
+    else if (completion.result == -EIO || completion.result == -EINVAL) {
+        // A TLS record that is not application data, or no multishot receive in this kernel.
+        leaveRing();
+        return;
+    }
+    else if (completion.result != -ENOBUFS) {    // Out of buffers only needs a new receive.
+        fail();
+        return;
+    }
+    if (!receiveArmed_) {
+        ring->receiveMultishot(socket_.impl()->sockfd(), receiveUserData_);
+        receiveArmed_ = true;
+    }
+}
+
+// Queues the next chain: up to MAX_LINKED records, each sent only after the one before it.
+void AsyncConnection::submitSends() {
+    if (closed_ || sendsInFlight_ > 0) return;
+    if (sending_.empty()) {
+        std::lock_guard<std::mutex> lock(outboxMutex_);
+        while (sending_.size() < MAX_LINKED && !outbox_.empty()) {
+            Batch batch;
+            while (!outbox_.empty() && (batch.bytes.empty() || batch.bytes.size() + outbox_.front().bytes.size() <= MAX_RECORD)) {
+                Pending& pending = outbox_.front();
+                batch.bytes.insert(batch.bytes.end(), pending.bytes.begin(), pending.bytes.end());
+                if (pending.done) batch.done.push_back(std::move(pending.done));
+                outbox_.pop_front();
+            }
+            sending_.push_back(std::move(batch));
+        }
+    }
+    if (sending_.empty()) {
+        if (closing_) fail();
+        return;
+    }
+
+    IoUring* ring = loop_.ring();
+    int fd = socket_.impl()->sockfd();
+    for (size_t i = 0; i < sending_.size(); ++i) {
+        Batch& batch = sending_[i];
+        ring->send(fd, batch.bytes.data() + batch.offset, batch.bytes.size() - batch.offset,
+                   sendUserData_, i + 1 < sending_.size());
+    }
+    sendsInFlight_ = sending_.size();
+    sendCursor_ = 0;
+    sendFailed_ = false;
+}
+
+void AsyncConnection::onRingSend(const IoUring::Completion& completion) {
+    Batch& batch = sending_[sendCursor_++];
+    --sendsInFlight_;
+    if (completion.result >= 0) {
+        batch.offset += static_cast<size_t>(completion.result);
+    }
+    else if (completion.result != -ECANCELED && completion.result != -EINTR && completion.result != -EAGAIN) {
+        sendFailed_ = true;
+    }
+    if (sendsInFlight_ > 0) return;
+
+    // The chain is over: complete what went out in full; a short or cancelled rest goes again.
+    std::vector<Completion> done;
+    while (!sending_.empty() && sending_.front().offset == sending_.front().bytes.size()) {
+        for (Completion& next : sending_.front().done) done.push_back(std::move(next));
+        sending_.pop_front();
+    }
+    for (Completion& next : done) next(true);
+
+    if (closed_) {
+        releaseRing();
+        return;
+    }
+    if (sendFailed_) {
+        fail();
+        return;
+    }
+    if (!ringMode_) {
+        // Left the ring meanwhile: OpenSSL writes the rest, in order.
+        writing_.clear();
+        writingOffset_ = 0;
+        for (Batch& rest : sending_) {
+            writing_.insert(writing_.end(), rest.bytes.begin() + static_cast<std::ptrdiff_t>(rest.offset), rest.bytes.end());
+            for (Completion& next : rest.done) writingDone_.push_back(std::move(next));
+        }
+        sending_.clear();
+        releaseRing();
+        writeSome();
+        return;
+    }
+    submitSends();
+}
@@ -0,0 +1,157 @@
+#include "ContextCache.h"
+#include "CipherSelector.h"
+#include "KernelTls.h"
+#include "TicketKeyRing.h"
+#include <Poco/Exception.h>
+#include <openssl/ssl.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <sstream>
+#include <tuple>
+
+namespace {
+
+// Modification time of `path`, or 0 if it is empty or cannot be read.
+time_t modified(const std::string& path) {
+    struct stat info;
+    if (path.empty() || ::stat(path.c_str(), &info) != 0) return 0;
+    return info.st_mtime;
+}
+
+}
+
+ContextConfig ContextConfig::client() {
+    return ContextConfig();
+}
+
+ContextConfig ContextConfig::server(const std::string& certificateFile, const std::string& privateKeyFile,
+                                    const std::string& caLocation) {
+    ContextConfig config;
+    config.usage = Poco::Net::Context::SERVER_USE;
+    config.certificateFile = certificateFile;
+    config.privateKeyFile = privateKeyFile;
+    config.caLocation = caLocation;
+    return config;
+}
+
+bool ContextConfig::operator<(const ContextConfig& other) const {
+    return std::tie(usage, privateKeyFile, certificateFile, caLocation, verificationMode, verificationDepth, loadDefaultCAs)
+         < std::tie(other.usage, other.privateKeyFile, other.certificateFile, other.caLocation,
+                    other.verificationMode, other.verificationDepth, other.loadDefaultCAs);
+}
+
+std::string ContextConfig::toString() const {
+    std::ostringstream out;
+    out << (usage == Poco::Net::Context::SERVER_USE || usage == Poco::Net::Context::TLS_SERVER_USE ? "server" : "client");
+    if (!certificateFile.empty()) out << " cert=" << certificateFile;
+    if (!privateKeyFile.empty()) out << " key=" << privateKeyFile;
+    if (!caLocation.empty()) out << " ca=" << caLocation;
+    if (loadDefaultCAs) out << " +default CAs";
+    return out.str();
+}
+
+ContextCache& ContextCache::instance() {
+    static ContextCache cache;
+    return cache;
+}
+
+ContextCache::ContextCache() : builds_(0) {
+}
+
+Poco::Net::Context::Ptr ContextCache::get(const ContextConfig& config) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = entries_.find(config);
+        if (found != entries_.end()) return found->second.context;
+    }
+
+    // Built outside the lock so a slow CA bundle does not hold up other configurations.
+    // Two threads racing on the same new configuration both build; the first one wins.
+    Entry entry;
+    entry.stamps = stamps(config);
+    entry.context = build(config);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++builds_;
+    return entries_.insert(std::make_pair(config, entry)).first->second.context;
+}
+
+bool ContextCache::reload(const ContextConfig& config) {
+    Entry entry;
+    entry.stamps = stamps(config);
+    try {
+        entry.context = build(config);
+    }
+    catch (const Poco::Exception& exc) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++builds_;
+    entries_[config] = entry;
+    return true;
+}
+
+bool ContextCache::reloadIfChanged(const ContextConfig& config) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = entries_.find(config);
+        if (found != entries_.end() && found->second.stamps == stamps(config)) return false;
+    }
+    return reload(config);
+}
+
+void ContextCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+}
+
+size_t ContextCache::builds() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return builds_;
+}
+
+Poco::Net::Context::Ptr ContextCache::build(const ContextConfig& config) {
+    Poco::Net::Context::Ptr context = new Poco::Net::Context(
+        config.usage,
+        config.privateKeyFile,
+        config.certificateFile,
+        config.caLocation,
+        config.verificationMode,
+        config.verificationDepth,
+        config.loadDefaultCAs,
+        CipherSelector::instance().tlsCipherList()
+    );
+    if (!CipherSelector::instance().applyTo(*context)) {
+        std::cerr << "TLS 1.3 cipher suites rejected: " << CipherSelector::instance().tlsCipherSuites()
+                  << "; using OpenSSL's default order" << std::endl;
+    }
+    KernelTls::enable(*context);
+
+    // Session resumption. Clients keep their tickets in SessionCache; servers seal them
+    // with the shared TicketKeyRing so tickets outlive a context reload.
+    if (context->isForServerUse()) {
+        context->enableSessionCache(true, "secure-vpn");
+        context->setSessionTimeout(static_cast<long>(TicketKeyRing::instance().ticketLifetime().count()));
+        TicketKeyRing::instance().install(*context);
+    }
+    else {
+        context->enableSessionCache(true);
+    }
+    // Allow psk_ke resumption: no ECDHE on a reconnect, so resuming costs no public-key
+    // operation at all. The trade-off is that resumed sessions are only as forward-secret
+    // as the ticket key, which rotates (see TicketKeyRing).
+    SSL_CTX_set_options(context->sslContext(), SSL_OP_ALLOW_NO_DHE_KEX);
+#if defined(SSL_OP_PREFER_NO_DHE_KEX)
+    SSL_CTX_set_options(context->sslContext(), SSL_OP_PREFER_NO_DHE_KEX);    // Servers pick psk_ke when offered.
+#endif
+    return context;
+}
+
+std::vector<time_t> ContextCache::stamps(const ContextConfig& config) {
+    std::vector<time_t> result;
+    result.push_back(modified(config.privateKeyFile));
+    result.push_back(modified(config.certificateFile));
+    result.push_back(modified(config.caLocation));
+    return result;
+}
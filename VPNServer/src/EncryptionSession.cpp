@@ -0,0 +1,34 @@
+#include "EncryptionSession.h"
+#include <Poco/Crypto/CipherFactory.h>
+#include <Poco/Crypto/CipherKey.h>
+
+EncryptionSession::EncryptionSession(const std::string& key)
+    : cipher_(Poco::Crypto::CipherFactory::defaultFactory().createCipher(
+          Poco::Crypto::CipherKey("aes-256-cbc", key))) {
+}
+
+std::vector<uint8_t> EncryptionSession::encrypt(const std::vector<uint8_t>& data) const {
+    try {
+        std::string encrypted = cipher_->encryptString(
+            std::string(reinterpret_cast<const char*>(data.data()), data.size())
+        );
+
+        return std::vector<uint8_t>(encrypted.begin(), encrypted.end());
+    }
+    catch (...) {
+        return std::vector<uint8_t>();
+    }
+}
+
+std::vector<uint8_t> EncryptionSession::decrypt(const std::vector<uint8_t>& data) const {
+    try {
+        std::string decrypted = cipher_->decryptString(
+            std::string(reinterpret_cast<const char*>(data.data()), data.size())
+        );
+
+        return std::vector<uint8_t>(decrypted.begin(), decrypted.end());
+    }
+    catch (...) {
+        return std::vector<uint8_t>();
+    }
+}
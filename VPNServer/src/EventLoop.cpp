@@ -0,0 +1,268 @@
+#include "EventLoop.h"
+#include <Poco/Net/SocketAddress.h>
+#include <Poco/Net/StreamSocketImpl.h>
+#include <cerrno>
+#include <poll.h>
+
+namespace {
+
+// Upper bound on one poll, so a lost wake-up costs at most this much latency.
+const Poco::Timespan POLL_TIMEOUT(0, 500000);
+const int POLL_TIMEOUT_MS = 500;
+
+// User data of the wake-up socket's poll; handlers get the values after it.
+const uint64_t WAKE_USER_DATA = IoUring::IGNORED + 1;
+
+uint32_t pollMask(int events) {
+    uint32_t mask = POLLERR | POLLHUP;
+    if (events & EventLoop::READABLE) mask |= POLLIN | POLLRDHUP;
+    if (events & EventLoop::WRITABLE) mask |= POLLOUT;
+    return mask;
+}
+
+int eventsOf(uint32_t mask) {
+    int events = 0;
+    if (mask & (POLLIN | POLLRDHUP)) events |= EventLoop::READABLE;
+    if (mask & POLLOUT) events |= EventLoop::WRITABLE;
+    if (mask & (POLLERR | POLLHUP)) events |= EventLoop::ERROR | EventLoop::READABLE;    // Reading finds out what.
+    return events;
+}
+
+}
+
+EventLoop::EventLoop()
+    : nextUserData_(WAKE_USER_DATA + 1)
+    , wakeSocket_(Poco::Net::SocketAddress("127.0.0.1", 0))
+    , wakePending_(false)
+    , load_(0)
+    , running_(true) {
+    wakeSocket_.connect(wakeSocket_.address());    // Datagrams to ourselves wake the poll.
+    wakeSocket_.setBlocking(false);
+    if (IoUring::available()) {
+        try {
+            ring_.reset(new IoUring());
+        }
+        catch (const std::exception&) {
+            // Out of locked memory or similar: epoll still works.
+        }
+    }
+    if (ring_) {
+        ring_->pollMultishot(wakeSocket_.impl()->sockfd(), pollMask(READABLE), WAKE_USER_DATA);
+    }
+    else {
+        pollSet_.add(wakeSocket_, READABLE);
+    }
+    thread_ = std::thread(&EventLoop::run, this);
+    threadId_ = thread_.get_id();
+}
+
+EventLoop::~EventLoop() {
+    stop();
+}
+
+void EventLoop::post(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        tasks_.push_back(std::move(task));
+    }
+    if (!inLoop()) wake();
+}
+
+void EventLoop::add(const Poco::Net::Socket& socket, int events, Handler handler) {
+    if (!ring_) {
+        handlers_[socket] = std::move(handler);
+        pollSet_.add(socket, events | ERROR);
+        load_ = handlers_.size();
+        return;
+    }
+
+    int fd = socket.impl()->sockfd();
+    uint64_t userData = addCompletion([this, socket, handler](const IoUring::Completion& completion) {
+        if (completion.result == -ECANCELED) return;    // Removed.
+        if (!completion.more()) {
+            // The kernel ended the multishot poll (overflow, error); arm it again.
+            auto watch = watches_.find(socket);
+            if (watch == watches_.end()) return;
+            ring_->pollMultishot(socket.impl()->sockfd(), pollMask(watch->second.events), watch->second.userData);
+        }
+        handler(completion.result < 0 ? ERROR | READABLE : eventsOf(static_cast<uint32_t>(completion.result)));
+    });
+    Watch watch;
+    watch.userData = userData;
+    watch.events = events;
+    watches_[socket] = watch;
+    ring_->pollMultishot(fd, pollMask(events), userData);
+    load_ = watches_.size();
+}
+
+void EventLoop::update(const Poco::Net::Socket& socket, int events) {
+    if (!ring_) {
+        pollSet_.update(socket, events | ERROR);
+        return;
+    }
+    auto watch = watches_.find(socket);
+    if (watch == watches_.end()) return;
+    watch->second.events = events;
+    ring_->pollUpdate(watch->second.userData, pollMask(events));
+}
+
+void EventLoop::remove(const Poco::Net::Socket& socket) {
+    if (!ring_) {
+        pollSet_.remove(socket);
+        handlers_.erase(socket);
+        load_ = handlers_.size();
+        return;
+    }
+    auto watch = watches_.find(socket);
+    if (watch == watches_.end()) return;
+    ring_->pollRemove(watch->second.userData);
+    removeCompletion(watch->second.userData);
+    watches_.erase(watch);
+    load_ = watches_.size();
+}
+
+void EventLoop::listen(const Poco::Net::ServerSocket& listener, AcceptHandler handler) {
+    if (!ring_) {
+        Poco::Net::ServerSocket socket(listener);
+        socket.setBlocking(false);
+        add(socket, READABLE, [socket, handler](int) mutable {
+            for (;;) {    // Everything in the backlog.
+                Poco::Net::StreamSocket accepted;
+                try {
+                    accepted = socket.acceptConnection();
+                }
+                catch (const Poco::Exception&) {
+                    return;    // Backlog empty.
+                }
+                accepted.setBlocking(true);
+                handler(accepted);
+            }
+        });
+        return;
+    }
+
+    // One submission accepts every connection until the kernel ends it.
+    int fd = listener.impl()->sockfd();
+    uint64_t userData = addCompletion([this, fd, handler](const IoUring::Completion& completion) {
+        if (completion.result >= 0) {
+            handler(Poco::Net::StreamSocket(new Poco::Net::StreamSocketImpl(completion.result)));
+        }
+        if (!completion.more() && completion.result != -ECANCELED && completion.result != -EBADF) {
+            ring_->acceptMultishot(fd, completion.userData);
+        }
+    });
+    ring_->acceptMultishot(fd, userData);
+}
+
+uint64_t EventLoop::addCompletion(CompletionHandler handler) {
+    uint64_t userData = nextUserData_++;    // Never reused: late completions find nothing.
+    completions_[userData] = std::move(handler);
+    return userData;
+}
+
+void EventLoop::removeCompletion(uint64_t userData) {
+    completions_.erase(userData);
+}
+
+void EventLoop::stop() {
+    if (!running_.exchange(false)) return;
+    wake();
+    if (thread_.joinable()) thread_.join();
+    ring_.reset();    // Ends the kernel's use of buffers the handlers still own.
+    handlers_.clear();
+    completions_.clear();
+    watches_.clear();
+}
+
+void EventLoop::run() {
+    if (ring_) {
+        runRing();
+    }
+    else {
+        runPoll();
+    }
+}
+
+void EventLoop::runPoll() {
+    while (running_) {
+        runTasks();
+        Poco::Net::PollSet::SocketModeMap ready;
+        try {
+            ready = pollSet_.poll(tasksPending() ? Poco::Timespan(0) : POLL_TIMEOUT);
+        }
+        catch (const Poco::Exception&) {
+            continue;    // Interrupted; poll again.
+        }
+        for (const auto& entry : ready) {
+            if (entry.first == wakeSocket_) {
+                drainWake();
+                continue;
+            }
+            // Copy the handler: it may remove its own socket.
+            auto found = handlers_.find(entry.first);
+            if (found == handlers_.end()) continue;
+            Handler handler = found->second;
+            handler(entry.second);
+        }
+    }
+}
+
+void EventLoop::runRing() {
+    std::vector<IoUring::Completion> ready;
+    while (running_) {
+        runTasks();
+        ready.clear();
+        // Submits everything the last round queued, then waits: one syscall per round.
+        if (!ring_->wait(tasksPending() ? 0 : POLL_TIMEOUT_MS, ready)) continue;
+        for (const IoUring::Completion& completion : ready) {
+            if (completion.userData == IoUring::IGNORED) continue;
+            if (completion.userData == WAKE_USER_DATA) {
+                drainWake();
+                if (!completion.more()) {
+                    ring_->pollMultishot(wakeSocket_.impl()->sockfd(), pollMask(READABLE), WAKE_USER_DATA);
+                }
+                continue;
+            }
+            auto found = completions_.find(completion.userData);
+            if (found == completions_.end()) continue;
+            CompletionHandler handler = found->second;
+            handler(completion);
+        }
+    }
+}
+
+void EventLoop::wake() {
+    if (wakePending_.exchange(true)) return;
+    try {
+        uint8_t byte = 0;
+        wakeSocket_.sendBytes(&byte, 1);
+    }
+    catch (const Poco::Exception&) {
+        wakePending_ = false;    // The poll timeout still picks the work up.
+    }
+}
+
+void EventLoop::drainWake() {
+    uint8_t drain[64];
+    try {
+        while (wakeSocket_.receiveBytes(drain, sizeof(drain)) > 0) {}
+    }
+    catch (const Poco::Exception&) {
+        // Nothing left to drain.
+    }
+    wakePending_ = false;
+}
+
+void EventLoop::runTasks() {
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        tasks.swap(tasks_);
+    }
+    for (Task& task : tasks) task();
+}
+
+bool EventLoop::tasksPending() {
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    return !tasks_.empty();
+}
@@ -0,0 +1,361 @@
+#include "IoUring.h"
+#include <cstdlib>
+#include <stdexcept>
+
+#if defined(VPN_IO_URING) && defined(__linux__)
+#define IO_URING_SUPPORTED 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#endif
+
+#if defined(IO_URING_SUPPORTED)
+
+namespace {
+
+const uint16_t BUFFER_GROUP = 0;
+
+int ringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+int ringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+// Whether the kernel knows every opcode the event loop uses.
+bool opcodesSupported(int fd) {
+    const unsigned slots = 64;
+    std::vector<uint8_t> memory(sizeof(io_uring_probe) + slots * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(memory.data());
+    if (ringRegister(fd, IORING_REGISTER_PROBE, probe, slots) < 0) return false;
+    for (unsigned opcode : {IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE, IORING_OP_ACCEPT, IORING_OP_RECV,
+                            IORING_OP_SEND, IORING_OP_ASYNC_CANCEL}) {
+        if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) return false;
+    }
+    return true;
+}
+
+}
+
+struct IoUring::Ring {
+    Ring() : fd(-1), sqMap(MAP_FAILED), sqMapSize(0), cqMap(MAP_FAILED), cqMapSize(0), sqes(nullptr),
+             sqesSize(0), buffers(nullptr), buffersSize(0), localTail(0), bufferTail(0) {}
+
+    ~Ring() {
+        if (fd >= 0) close(fd);    // Before the buffers go: the kernel stops using them.
+        if (buffers) munmap(buffers, buffersSize);
+        if (sqes) munmap(sqes, sqesSize);
+        if (cqMap != MAP_FAILED && cqMap != sqMap) munmap(cqMap, cqMapSize);
+        if (sqMap != MAP_FAILED) munmap(sqMap, sqMapSize);
+    }
+
+    int fd;
+    void* sqMap;
+    size_t sqMapSize;
+    void* cqMap;
+    size_t cqMapSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    io_uring_cqe* cqes;
+
+    io_uring_buf_ring* buffers;    // Ring of descriptors, followed by the buffers themselves.
+    size_t buffersSize;
+
+    unsigned localTail;            // Submission tail not yet published to the kernel.
+    uint16_t bufferTail;
+
+    uint8_t* bufferMemory() const {
+        return reinterpret_cast<uint8_t*>(buffers) + BUFFER_COUNT * sizeof(io_uring_buf);
+    }
+
+    // The descriptors are indexed by hand: in C++ the header's flexible `bufs` array starts
+    // one (empty) member too late. The ring tail overlays the first descriptor's `resv`.
+    void provide(int id) {
+        io_uring_buf* entries = reinterpret_cast<io_uring_buf*>(buffers);
+        io_uring_buf* entry = &entries[bufferTail & (BUFFER_COUNT - 1)];
+        entry->addr = reinterpret_cast<uint64_t>(bufferMemory() + static_cast<size_t>(id) * BUFFER_SIZE);
+        entry->len = static_cast<uint32_t>(BUFFER_SIZE);
+        entry->bid = static_cast<uint16_t>(id);
+        ++bufferTail;
+        __atomic_store_n(&entries[0].resv, bufferTail, __ATOMIC_RELEASE);
+    }
+
+    unsigned pending() const {
+        return localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    }
+};
+
+bool IoUring::Completion::more() const {
+    return (flags & IORING_CQE_F_MORE) != 0;
+}
+
+int IoUring::Completion::buffer() const {
+    return (flags & IORING_CQE_F_BUFFER) ? static_cast<int>(flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+}
+
+bool IoUring::available() {
+    static const bool supported = []() {
+        if (std::getenv("VPN_NO_IO_URING")) return false;
+        try {
+            IoUring probe(8);    // Also registers a buffer ring, which needs 5.19.
+            return opcodesSupported(probe.ring_->fd);
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+    }();
+    return supported;
+}
+
+IoUring::IoUring(unsigned entries) : ring_(new Ring()) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;    // Multishot operations complete many times per submission.
+    Ring& ring = *ring_;
+    ring.fd = ringSetup(entries, &params);
+    if (ring.fd < 0) throw std::runtime_error("io_uring_setup failed: " + std::string(std::strerror(errno)));
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        throw std::runtime_error("io_uring: kernel too old");
+    }
+
+    ring.sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && ring.cqMapSize > ring.sqMapSize) ring.sqMapSize = ring.cqMapSize;
+    ring.sqMap = mmap(nullptr, ring.sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring.fd, IORING_OFF_SQ_RING);
+    if (ring.sqMap == MAP_FAILED) throw std::runtime_error("io_uring: cannot map the submission ring");
+    ring.cqMap = single ? ring.sqMap
+                        : mmap(nullptr, ring.cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               ring.fd, IORING_OFF_CQ_RING);
+    if (ring.cqMap == MAP_FAILED) throw std::runtime_error("io_uring: cannot map the completion ring");
+    ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring.fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) throw std::runtime_error("io_uring: cannot map the submission entries");
+    ring.sqes = static_cast<io_uring_sqe*>(sqes);
+
+    uint8_t* sq = static_cast<uint8_t*>(ring.sqMap);
+    uint8_t* cq = static_cast<uint8_t*>(ring.cqMap);
+    ring.sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring.sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring.sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring.sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring.sqEntries = params.sq_entries;
+    ring.cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring.cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring.cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring.cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    ring.localTail = *ring.sqTail;
+
+    // Provided buffers: one page-aligned mapping for the descriptor ring and the buffers.
+    ring.buffersSize = BUFFER_COUNT * sizeof(io_uring_buf) + BUFFER_COUNT * BUFFER_SIZE;
+    void* buffers = mmap(nullptr, ring.buffersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED) throw std::runtime_error("io_uring: cannot allocate receive buffers");
+    ring.buffers = static_cast<io_uring_buf_ring*>(buffers);
+    io_uring_buf_reg registration;
+    std::memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = reinterpret_cast<uint64_t>(ring.buffers);
+    registration.ring_entries = BUFFER_COUNT;
+    registration.bgid = BUFFER_GROUP;
+    if (ringRegister(ring.fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        throw std::runtime_error("io_uring: provided buffer rings not supported");
+    }
+    for (unsigned id = 0; id < BUFFER_COUNT; ++id) {
+        ring.provide(static_cast<int>(id));
+    }
+}
+
+IoUring::~IoUring() {
+}
+
+void* IoUring::nextEntry() {
+    Ring& ring = *ring_;
+    if (ring.pending() >= ring.sqEntries) submit();    // Full: hand the batch over early.
+    io_uring_sqe* entry = &ring.sqes[ring.localTail & ring.sqMask];
+    std::memset(entry, 0, sizeof(*entry));
+    ring.sqArray[ring.localTail & ring.sqMask] = ring.localTail & ring.sqMask;
+    ++ring.localTail;
+    return entry;
+}
+
+void IoUring::pollMultishot(int fd, uint32_t pollMask, uint64_t userData) {
+    io_uring_sqe* entry = static_cast<io_uring_sqe*>(nextEntry());
+    entry->opcode = IORING_OP_POLL_ADD;
+    entry->fd = fd;
+    entry->poll32_events = pollMask;
+    entry->len = IORING_POLL_ADD_MULTI;
+    entry->user_data = userData;
+}
+
+void IoUring::pollUpdate(uint64_t target, uint32_t pollMask) {
+    io_uring_sqe* entry = static_cast<io_uring_sqe*>(nextEntry());
+    entry->opcode = IORING_OP_POLL_REMOVE;
+    entry->fd = -1;
+    entry->addr = target;
+    entry->poll32_events = pollMask;
+    entry->len = IORING_POLL_UPDATE_EVENTS | IORING_POLL_ADD_MULTI;
+    entry->user_data = IGNORED;
+}
+
+void IoUring::pollRemove(uint64_t target) {
+    io_uring_sqe* entry = static_cast<io_uring_sqe*>(nextEntry());
+    entry->opcode = IORING_OP_POLL_REMOVE;
+    entry->fd = -1;
+    entry->addr = target;
+    entry->user_data = IGNORED;
+}
+
+void IoUring::acceptMultishot(int fd, uint64_t userData) {
+    io_uring_sqe* entry = static_cast<io_uring_sqe*>(nextEntry());
+    entry->opcode = IORING_OP_ACCEPT;
+    entry->fd = fd;
+    entry->ioprio = IORING_ACCEPT_MULTISHOT;
+    entry->accept_flags = SOCK_CLOEXEC;
+    entry->user_data = userData;
+}
+
+void IoUring::receiveMultishot(int fd, uint64_t userData) {
+    io_uring_sqe* entry = static_cast<io_uring_sqe*>(nextEntry());
+    entry->opcode = IORING_OP_RECV;
+    entry->fd = fd;
+    entry->flags = IOSQE_BUFFER_SELECT;
+    entry->buf_group = BUFFER_GROUP;
+    entry->ioprio = IORING_RECV_MULTISHOT;
+    entry->user_data = userData;
+}
+
+void IoUring::send(int fd, const void* data, size_t length, uint64_t userData, bool linkNext) {
+    io_uring_sqe* entry = static_cast<io_uring_sqe*>(nextEntry());
+    entry->opcode = IORING_OP_SEND;
+    entry->fd = fd;
+    entry->addr = reinterpret_cast<uint64_t>(data);
+    entry->len = static_cast<uint32_t>(length);
+    entry->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;    // The kernel retries short sends itself.
+    if (linkNext) entry->flags = IOSQE_IO_LINK;
+    entry->user_data = userData;
+}
+
+void IoUring::cancel(uint64_t userData) {
+    io_uring_sqe* entry = static_cast<io_uring_sqe*>(nextEntry());
+    entry->opcode = IORING_OP_ASYNC_CANCEL;
+    entry->fd = -1;
+    entry->addr = userData;
+    entry->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    entry->user_data = IGNORED;
+}
+
+const uint8_t* IoUring::bufferData(int buffer) const {
+    return ring_->bufferMemory() + static_cast<size_t>(buffer) * BUFFER_SIZE;
+}
+
+void IoUring::recycleBuffer(int buffer) {
+    if (buffer >= 0 && static_cast<unsigned>(buffer) < BUFFER_COUNT) ring_->provide(buffer);
+}
+
+bool IoUring::submit() {
+    Ring& ring = *ring_;
+    __atomic_store_n(ring.sqTail, ring.localTail, __ATOMIC_RELEASE);
+    unsigned pending = ring.pending();
+    if (pending == 0) return true;
+    int submitted = ringEnter(ring.fd, pending, 0, 0, nullptr, 0);
+    ++stats_.enters;
+    if (submitted < 0) return errno == EINTR || errno == EAGAIN || errno == EBUSY;
+    stats_.submitted += static_cast<unsigned>(submitted);
+    return true;
+}
+
+bool IoUring::wait(int timeoutMs, std::vector<Completion>& completions) {
+    Ring& ring = *ring_;
+    __atomic_store_n(ring.sqTail, ring.localTail, __ATOMIC_RELEASE);
+    unsigned pending = ring.pending();
+    bool ready = *ring.cqHead != __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+
+    if (timeoutMs > 0 && !ready) {
+        __kernel_timespec timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+        io_uring_getevents_arg arg;
+        std::memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&timeout);
+        int submitted = ringEnter(ring.fd, pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        ++stats_.enters;
+        if (submitted < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY) return false;
+        stats_.submitted += pending - ring.pending();
+    }
+    else if (pending > 0 && !submit()) {
+        return false;
+    }
+
+    unsigned head = *ring.cqHead;
+    unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+        Completion completion;
+        completion.userData = cqe.user_data;
+        completion.result = cqe.res;
+        completion.flags = cqe.flags;
+        completions.push_back(completion);
+        ++stats_.completed;
+    }
+    __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else
+
+// Without VPN_IO_URING: never available, and constructing a ring fails.
+
+struct IoUring::Ring {
+};
+
+bool IoUring::Completion::more() const { return false; }
+int IoUring::Completion::buffer() const { return -1; }
+
+bool IoUring::available() {
+    return false;
+}
+
+IoUring::IoUring(unsigned entries) {
+    (void)entries;
+    throw std::runtime_error("io_uring support not compiled in");
+}
+
+IoUring::~IoUring() {
+}
+
+void* IoUring::nextEntry() { return nullptr; }
+void IoUring::pollMultishot(int, uint32_t, uint64_t) {}
+void IoUring::pollUpdate(uint64_t, uint32_t) {}
+void IoUring::pollRemove(uint64_t) {}
+void IoUring::acceptMultishot(int, uint64_t) {}
+void IoUring::receiveMultishot(int, uint64_t) {}
+void IoUring::send(int, const void*, size_t, uint64_t, bool) {}
+void IoUring::cancel(uint64_t) {}
+const uint8_t* IoUring::bufferData(int) const { return nullptr; }
+void IoUring::recycleBuffer(int) {}
+bool IoUring::submit() { return false; }
+bool IoUring::wait(int, std::vector<Completion>&) { return false; }
+
+#endif
@@ -0,0 +1,62 @@
+#include "ProtectionMode.h"
+
+namespace {
+
+const uint8_t OFFER_MAGIC[3] = {'V', 'P', 'O'};
+const uint8_t REPLY_MAGIC[3] = {'V', 'P', 'R'};
+
+// Single-layer modes first: they halve the crypto work per byte.
+const ProtectionMode PREFERENCE[] = {PROTECTION_TLS_ONLY, PROTECTION_AEAD_ONLY, PROTECTION_DOUBLE};
+
+std::vector<uint8_t> message(const uint8_t* magic, uint8_t value) {
+    return std::vector<uint8_t>{magic[0], magic[1], magic[2], value};
+}
+
+bool parse(const uint8_t* magic, const uint8_t* data, size_t length, uint8_t& value) {
+    if (length != ProtectionNegotiation::MESSAGE_SIZE) return false;
+    if (data[0] != magic[0] || data[1] != magic[1] || data[2] != magic[2]) return false;
+    value = data[3];
+    return true;
+}
+
+}
+
+std::vector<uint8_t> ProtectionNegotiation::offer(uint8_t modes) {
+    return message(OFFER_MAGIC, modes);
+}
+
+bool ProtectionNegotiation::parseOffer(const uint8_t* data, size_t length, uint8_t& modes) {
+    return parse(OFFER_MAGIC, data, length, modes);
+}
+
+std::vector<uint8_t> ProtectionNegotiation::reply(ProtectionMode mode) {
+    return message(REPLY_MAGIC, mode);
+}
+
+bool ProtectionNegotiation::parseReply(const uint8_t* data, size_t length, ProtectionMode& mode) {
+    uint8_t value = 0;
+    if (!parse(REPLY_MAGIC, data, length, value)) return false;
+    for (ProtectionMode candidate : PREFERENCE) {
+        if (value == candidate) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+ProtectionMode ProtectionNegotiation::choose(uint8_t offered, uint8_t supported) {
+    for (ProtectionMode candidate : PREFERENCE) {
+        if (offered & supported & candidate) return candidate;
+    }
+    return PROTECTION_NONE;
+}
+
+const char* ProtectionNegotiation::name(ProtectionMode mode) {
+    switch (mode) {
+    case PROTECTION_DOUBLE: return "tls+inner-encryption";
+    case PROTECTION_TLS_ONLY: return "tls-only";
+    case PROTECTION_AEAD_ONLY: return "aead-only";
+    default: return "none";
+    }
+}
@@ -0,0 +1,47 @@
+#include "RecordSizer.h"
+#include <sstream>
+
+namespace {
+
+const size_t BUCKET_LIMITS[RecordSizer::SIZE_BUCKETS] = {512, 1024, 2048, 4096, 8192, 16384};
+const char* BUCKET_NAMES[RecordSizer::SIZE_BUCKETS] = {"512B", "1KB", "2KB", "4KB", "8KB", "16KB"};
+
+}
+
+std::string RecordSizer::Stats::toString() const {
+    std::ostringstream out;
+    out << "small=" << smallRecords << " large=" << largeRecords << " resets=" << resets;
+    for (size_t i = 0; i < SIZE_BUCKETS; ++i) {
+        out << " <=" << BUCKET_NAMES[i] << ":" << bySize[i];
+    }
+    return out.str();
+}
+
+RecordSizer::RecordSizer(const Policy& policy)
+    : policy_(policy)
+    , large_(false)
+    , streamed_(0)
+    , stats_() {
+}
+
+size_t RecordSizer::recordLimit(std::chrono::steady_clock::time_point now) {
+    if (streamed_ > 0 && now - lastWrite_ > policy_.idleTimeout) {
+        if (large_) ++stats_.resets;
+        large_ = false;
+        streamed_ = 0;
+    }
+    return large_ ? policy_.largeRecord : policy_.smallRecord;
+}
+
+void RecordSizer::recorded(size_t length, std::chrono::steady_clock::time_point now) {
+    if (large_) ++stats_.largeRecords;
+    else ++stats_.smallRecords;
+
+    size_t bucket = 0;
+    while (bucket + 1 < SIZE_BUCKETS && length > BUCKET_LIMITS[bucket]) ++bucket;
+    ++stats_.bySize[bucket];
+
+    lastWrite_ = now;
+    streamed_ += length;
+    if (!large_ && streamed_ >= policy_.growAfterBytes) large_ = true;
+}
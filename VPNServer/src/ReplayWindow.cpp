@@ -0,0 +1,29 @@
+#include "ReplayWindow.h"
+#include <cstring>
+
+ReplayWindow::ReplayWindow() : highest_(0) {
+    std::memset(bitmap_, 0, sizeof(bitmap_));
+}
+
+bool ReplayWindow::check(uint64_t counter) const {
+    if (counter > highest_) return true;
+    if (highest_ - counter >= WINDOW_SIZE) return false;
+
+    uint64_t word = bitmap_[(counter / WORD_BITS) % WORDS];
+    return ((word >> (counter % WORD_BITS)) & 1) == 0;
+}
+
+void ReplayWindow::update(uint64_t counter) {
+    if (counter > highest_) {
+        // Clear the words the window slides over; after a jump of more than the
+        // whole bitmap every word is cleared once and nothing more.
+        uint64_t currentWord = highest_ / WORD_BITS;
+        uint64_t steps = counter / WORD_BITS - currentWord;
+        if (steps > WORDS) steps = WORDS;
+        for (uint64_t i = 1; i <= steps; ++i) {
+            bitmap_[(currentWord + i) % WORDS] = 0;
+        }
+        highest_ = counter;
+    }
+    bitmap_[(counter / WORD_BITS) % WORDS] |= uint64_t(1) << (counter % WORD_BITS);
+}
@@ -0,0 +1,128 @@
+#include "TunDevice.h"
+#include <memory>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+TunDevice::TunDevice(const std::string& name, bool multiQueue)
+    : fd_(-1)
+    , wakeFd_(-1) {
+    if (name.size() >= IFNAMSIZ) {
+        throw std::runtime_error("TUN device name too long: " + name);
+    }
+    fd_ = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd_ < 0) {
+        throw std::runtime_error(std::string("Cannot open /dev/net/tun: ") + std::strerror(errno));
+    }
+    ifreq request;
+    std::memset(&request, 0, sizeof(request));
+    request.ifr_flags = IFF_TUN | IFF_NO_PI | (multiQueue ? IFF_MULTI_QUEUE : 0);
+    std::strncpy(request.ifr_name, name.c_str(), IFNAMSIZ - 1);
+    if (ioctl(fd_, TUNSETIFF, &request) < 0) {
+        int error = errno;
+        ::close(fd_);
+        throw std::runtime_error("Cannot attach TUN device " + name + ": " + std::strerror(error));
+    }
+    name_ = request.ifr_name;    // The kernel's choice if `name` was empty.
+
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd_ < 0) {
+        int error = errno;
+        ::close(fd_);
+        throw std::runtime_error(std::string("Cannot create eventfd: ") + std::strerror(error));
+    }
+}
+
+TunDevice::~TunDevice() {
+    ::close(wakeFd_);
+    ::close(fd_);
+}
+
+PacketQueues TunDevice::openQueues(const std::string& name, unsigned count) {
+    if (count <= 1) {
+        return PacketQueues({std::make_shared<TunDevice>(name)});
+    }
+    std::vector<std::shared_ptr<PacketSource>> queues;
+    std::string attached = name;
+    for (unsigned i = 0; i < count && i < MAX_QUEUES; ++i) {
+        queues.push_back(std::make_shared<TunDevice>(attached, true));
+        attached = queues.back()->name();    // The kernel's choice if `name` was empty.
+    }
+    return PacketQueues(std::move(queues));
+}
+
+int TunDevice::readBatch(PacketBatch& batch, int timeoutMs) {
+    pollfd fds[2];
+    fds[0].fd = fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeFd_;
+    fds[1].events = POLLIN;
+    int ready = poll(fds, 2, timeoutMs);
+    if (ready < 0) return errno == EINTR ? 0 : -1;
+    if (fds[1].revents) return -1;    // Closed.
+    if (ready == 0) return 0;
+
+    int count = 0;
+    while (!batch.full()) {
+        ssize_t received = read(fd_, batch.nextSlot(), batch.slotSize());
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;    // Drained.
+            return count > 0 ? count : -1;
+        }
+        if (received == 0) continue;
+        batch.commit(static_cast<size_t>(received));
+        ++count;
+    }
+    return count;
+}
+
+bool TunDevice::write(const uint8_t* packet, size_t length) {
+    for (;;) {
+        ssize_t written = ::write(fd_, packet, length);
+        if (written >= 0) return static_cast<size_t>(written) == length;
+        if (errno != EINTR) return false;    // EAGAIN: queue full, drop like a router would.
+    }
+}
+
+void TunDevice::close() {
+    uint64_t one = 1;
+    if (::write(wakeFd_, &one, sizeof(one)) < 0) {
+        // Already signalled; the counter is saturated, not reset.
+    }
+}
+
+#else
+
+TunDevice::TunDevice(const std::string& name, bool)
+    : fd_(-1)
+    , wakeFd_(-1) {
+    throw std::runtime_error("TUN devices need Linux: " + name);
+}
+
+TunDevice::~TunDevice() {}
+
+PacketQueues TunDevice::openQueues(const std::string& name, unsigned) {
+    return PacketQueues({std::make_shared<TunDevice>(name)});
+}
+
+int TunDevice::readBatch(PacketBatch&, int) {
+    return -1;
+}
+
+bool TunDevice::write(const uint8_t*, size_t) {
+    return false;
+}
+
+void TunDevice::close() {}
+
+#endif
@@ -1,23 +1,19 @@
-#include <Poco/Net/SecureServerSocket.h>    //Provides a server socket class for secure SSL/TLS connections.
-#include <Poco/Net/SecureStreamSocket.h>    //Provides a stream socket class for secure SSL/TLS connections.
+#include "VPNServer.h"
+#include "CipherSelector.h"                 //Orders the TLS cipher suites by measured speed on this CPU.
+#include "KernelTls.h"                      //Optional kernel TLS offload after the handshake.
+#include "ProtectionMode.h"                 //Negotiates single or double encryption per client.
 #include <Poco/Net/Context.h>               //Represents the SSL context, managing certificates, keys.
 #include <Poco/Net/SSLManager.h>            //Handles the initialization and cleanup of the SSL/TLS subsystem.
-#include <Poco/Thread.h>                    //Provide thread management classes.
-#include <Poco/ThreadPool.h>
-#include <Poco/Logger.h>
 #include <Poco/FileChannel.h>                //Provide logging utilities for file-based logging with formatted log messages.(Logger.h,PatternFormatter.h,FormattingChannel.h)
 #include <Poco/PatternFormatter.h>
 #include <Poco/FormattingChannel.h>
 #include <Poco/AutoPtr.h>                    //Provides smart pointer functionality for automatic memory management.
 #include <iostream>
-#include <vector>
-#include <map>                               //Key-value pair container for managing client connections.
-#include <mutex>                             // Provides thread-safety for shared resources.
-#include <memory>                            //Provides smart pointers like std::shared_ptr.
 #include <functional>                        //For using std::function and lambda expressions.
+#include <chrono>
 
 // Helper class to wrap lambdas for Poco::Runnable
-// This allows using lambda functions as tasks in Poco thread pools.
+// This allows using lambda functions as tasks in Poco threads.
 class RunnableWrapper : public Poco::Runnable {
 private:
     std::function<void()> task;
@@ -30,215 +26,552 @@ public:
     }
 };
 
-class VPNServer {
-private:
-    //Secure server socket for handling incoming SSL/TLS connections.
-    Poco::Net::SecureServerSocket serverSocket;
-    Poco::ThreadPool threadPool;    // Thread pool for managing client handling threads.
-    bool isRunning;                //Flag to indicate if the server is running.
-    mutable std::mutex clientsMutex; // Use mutable to allow modification in const methods
-    std::map<std::string, Poco::Net::SecureStreamSocket> clients; // Active client connections.
-    Poco::Logger& logger;    //// Logger for logging server events.
-    static const size_t BUFFER_SIZE = 4096;    // Buffer size for receiving data.
-
-    // Initializes the SSL context for secure connections.
-    Poco::Net::Context::Ptr getSSLContext() {
-        return new Poco::Net::Context(
-            Poco::Net::Context::SERVER_USE,    // Context for server-side SSL.
-            "server.crt",     // Certificate path
-            "server.key",     // Private key path
-            "cafile.pem",     // CA certificates file
-            Poco::Net::Context::VERIFY_RELAXED,
-            9,                // Verification mode
-            true,             // Load default CA certificates
-            "ALL:!ADH:!LOW:!EXP:!MD5:@STRENGTH" // Cipher list
-        );
-    }
-
-    // Initializes the logger with a file output channel and formatted messages.
-    static Poco::Logger& initLogger() {
-        Poco::AutoPtr<Poco::FileChannel> fileChannel(new Poco::FileChannel("vpn_server.log"));
-        Poco::AutoPtr<Poco::PatternFormatter> formatter(new Poco::PatternFormatter);
-        formatter->setProperty("pattern", "%Y-%m-%d %H:%M:%S.%i [%p] %s: %t");    // Log message format.
-        Poco::AutoPtr<Poco::FormattingChannel> formattingChannel(
-            new Poco::FormattingChannel(formatter, fileChannel));
-        Poco::Logger::root().setChannel(formattingChannel);
-        return Poco::Logger::get("VPNServer");
-    }
-    // Handles communication with a connected client.
-    void handleClient(Poco::Net::SecureStreamSocket& clientSocket) {
-        std::string clientId = clientSocket.peerAddress().toString();
-        logger.information("New client connected: " + clientId);
+VPNServer::VPNServer(uint16_t port, const std::string& encryptionKey, bool enableUdp)
+    : isRunning(false)
+    , nextLoopIndex(0)
+    , logger(initLogger())
+    , encryptionKey(encryptionKey)
+    , contextConfig(ContextConfig::server("server.crt", "server.key", "cafile.pem"))
+    , port(port)
+    , udpEnabled(false) {
+
+    // Initialize SSL
+    Poco::Net::initializeSSL();    // Initialize the SSL subsystem.
+
+    // Build the SSL context once up front (so bad certificates fail here), then listen
+    ContextCache::instance().get(contextConfig);
+    serverSocket = Poco::Net::ServerSocket(
+        Poco::Net::SocketAddress("0.0.0.0", port),  // Bind to all network interfaces on the specified port.
+        64      // Connection backlog.
+    );
 
+    if (enableUdp) {
         try {
-            // Add client to active connections
-            {
-                std::lock_guard<std::mutex> lock(clientsMutex);
-                clients[clientId] = clientSocket;
+            udpSocket.bind(Poco::Net::SocketAddress("0.0.0.0", port), true);
+            udpSocket.setReceiveTimeout(Poco::Timespan(1, 0));    // Lets the receiver notice stop().
+            udpEnabled = true;
+        }
+        catch (Poco::Exception& e) {
+            logger.warning("UDP data channel disabled: " + e.displayText());
+        }
+    }
+    // One event loop per core drives all client connections.
+    unsigned loops = std::thread::hardware_concurrency();
+    for (unsigned i = 0; i < (loops > 0 ? loops : 1); ++i) {
+        eventLoops.emplace_back(new EventLoop());
+    }
+    logger.information("VPN Server initialized on port " + std::to_string(port)
+                       + " with " + std::to_string(eventLoops.size()) + " event loops ("
+                       + eventLoops.front()->backend() + ")");
+    logger.information("Cipher selection: " + CipherSelector::instance().describe());
+    logger.information(std::string("Kernel TLS: ") + (KernelTls::available() ? "available" : "unavailable"));
+}
+
+VPNServer::~VPNServer() {
+    stop();    // Stop the server and clean up resources.
+    Poco::Net::uninitializeSSL();    // Uninitialize the SSL subsystem.
+}
+
+uint8_t VPNServer::supportedModes() const {
+    return PROTECTION_TLS_ONLY | (encryptionKey.empty() ? PROTECTION_NONE : PROTECTION_DOUBLE);
+}
+
+Poco::Net::SecureStreamSocket VPNServer::secureConnection(const Poco::Net::StreamSocket& socket) {
+    return Poco::Net::SecureStreamSocket::attach(socket, ContextCache::instance().get(contextConfig));
+}
+
+void VPNServer::reloadCertificatesIfChanged() {
+    if (ContextCache::instance().reloadIfChanged(contextConfig)) {
+        logger.information("SSL context reloaded: " + contextConfig.toString());
+    }
+}
+
+Poco::Logger& VPNServer::initLogger() {
+    Poco::AutoPtr<Poco::FileChannel> fileChannel(new Poco::FileChannel("vpn_server.log"));
+    Poco::AutoPtr<Poco::PatternFormatter> formatter(new Poco::PatternFormatter);
+    formatter->setProperty("pattern", "%Y-%m-%d %H:%M:%S.%i [%p] %s: %t");    // Log message format.
+    Poco::AutoPtr<Poco::FormattingChannel> formattingChannel(
+        new Poco::FormattingChannel(formatter, fileChannel));
+    Poco::Logger::root().setChannel(formattingChannel);
+    return Poco::Logger::get("VPNServer");
+}
+
+EventLoop& VPNServer::nextLoop() {
+    return *eventLoops[nextLoopIndex++ % eventLoops.size()];
+}
+
+void VPNServer::handleClient(const Poco::Net::SecureStreamSocket& clientSocket) {
+    std::shared_ptr<Client> client = std::make_shared<Client>();
+    client->id = clientSocket.peerAddress().toString();
+    logger.information("New client connected: " + client->id);
+    if (!encryptionKey.empty()) {
+        client->session.reset(new EncryptionSession(encryptionKey));
+    }
+
+    // The handlers keep the client alive; the connection drops them when it closes.
+    client->connection = AsyncConnection::create(nextLoop(), clientSocket,
+        [this, client](const FrameView& frame) { onFrame(*client, frame); },
+        [this, client]() { onClosed(*client); });
+
+    // Stream data is consumed as it arrives, so credit goes straight back and a
+    // stream never waits on another one.
+    AsyncConnection* connection = client->connection.get();
+    client->streams.reset(new StreamMux(StreamMux::SERVER,
+        [connection](FrameType type, uint8_t flags, const uint8_t* payload, size_t length) {
+            return connection->sendFrame(type, flags, payload, length);
+        }));
+    std::string clientId = client->id;
+    client->streams->setHandler([this, clientId](uint32_t id, const uint8_t* data, size_t length) {
+        if (length == 0) {
+            logger.information("Stream " + std::to_string(id) + " of client " + clientId + " closed");
+            return;
+        }
+        handleReceivedData(clientId + " stream " + std::to_string(id), data, length, nullptr);
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        clients[client->id] = client;
+    }
+    client->connection->start();
+}
+
+void VPNServer::onFrame(Client& client, const FrameView& frame) {
+    // The first frame may be a protection mode offer.
+    if (!client.negotiated && frame.type == FRAME_HELLO) {
+        client.negotiated = true;
+        if (!negotiate(client, frame)) {
+            client.connection->close();    // After the reply has gone out.
+        }
+        return;
+    }
+    client.negotiated = true;
+    if (StreamMux::isStreamFrame(frame.type)) {
+        if (!client.streams->handleFrame(frame)) {
+            logger.error("Stream protocol violation by client " + client.id);
+            client.connection->close();
+        }
+        return;
+    }
+    if (frame.type == FRAME_UDP_REQUEST) {
+        // A client asks again when it probes anew; the new session replaces the old one.
+        if (client.udpSessionId != 0) {
+            std::lock_guard<std::mutex> lock(udpMutex);
+            udpSessions.erase(client.udpSessionId);
+            client.udpSessionId = 0;
+        }
+        client.udpSessionId = openUdpSession(client);
+        return;
+    }
+    handleFrame(client, frame);
+}
+
+void VPNServer::onClosed(Client& client) {
+    client.streams->shutdown();
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        clients.erase(client.id);
+    }
+    if (client.udpSessionId != 0) {
+        std::lock_guard<std::mutex> lock(udpMutex);
+        udpSessions.erase(client.udpSessionId);
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(routesMutex);
+        for (auto route = routes.begin(); route != routes.end();) {
+            if (route->second.clientId == client.id) {
+                route = routes.erase(route);
             }
+            else {
+                ++route;
+            }
+        }
+    }
+    logger.information("Client disconnected and cleaned up: " + client.id);
+}
 
-            std::vector<uint8_t> buffer(BUFFER_SIZE);
-            bool clientConnected = true;
+bool VPNServer::negotiate(Client& client, const FrameView& frame) {
+    uint8_t offered = 0;
+    if (!ProtectionNegotiation::parseOffer(frame.payload, frame.length, offered)) {
+        logger.warning("Malformed protection offer from client " + client.id);
+        return false;
+    }
+    ProtectionMode mode = ProtectionNegotiation::choose(offered, supportedModes());
+    std::vector<uint8_t> reply = ProtectionNegotiation::reply(mode);
+    sendFrame(*client.connection, FRAME_HELLO, reply.data(), reply.size());
+    if (mode == PROTECTION_NONE) {
+        logger.warning("No common protection mode with client " + client.id);
+        return false;
+    }
+    if (mode != PROTECTION_DOUBLE) {
+        client.session.reset();    // TLS already protects every byte.
+    }
+    logger.information("Client " + client.id + " uses " + ProtectionNegotiation::name(mode)
+                       + ", kernel TLS " + KernelTls::status(client.connection->socket()).toString());
+    return true;
+}
 
-            while (clientConnected && isRunning) {
-                try {
-                    int received = clientSocket.receiveBytes(buffer.data(), BUFFER_SIZE);
-                    
-                    if (received <= 0) {
-                        logger.warning("Client disconnected: " + clientId);
-                        break;
-                    }
+void VPNServer::sendFrame(AsyncConnection& connection, FrameType type,
+                          const uint8_t* payload, size_t length) {
+    connection.sendFrame(type, 0, payload, length);
+}
 
-                    // Process received data
-                    handleReceivedData(clientId, buffer, received);
-                }
-                catch (Poco::TimeoutException&) {
-                    // Timeout is normal, continue listening for data
-                    continue;
+uint64_t VPNServer::openUdpSession(Client& client) {
+    if (!udpEnabled) {
+        sendFrame(*client.connection, FRAME_UDP_PARAMS, nullptr, 0);
+        return 0;
+    }
+    UdpChannelParams params = UdpChannelParams::generate(port, CipherSelector::instance().preferredAead());
+    std::shared_ptr<UdpSession> udp = std::make_shared<UdpSession>(params, client.id, client.session);
+    {
+        std::lock_guard<std::mutex> lock(udpMutex);
+        udpSessions[params.sessionId] = udp;
+    }
+    {
+        // Addresses learned before the channel was opened switch their downlink to it.
+        std::unique_lock<std::shared_mutex> lock(routesMutex);
+        for (auto& route : routes) {
+            if (route.second.clientId == client.id) {
+                route.second.udp = udp;
+            }
+        }
+    }
+    std::vector<uint8_t> encoded = params.encode();
+    sendFrame(*client.connection, FRAME_UDP_PARAMS, encoded.data(), encoded.size());
+    logger.information("UDP data channel offered to client " + client.id);
+    return params.sessionId;
+}
+
+void VPNServer::handleUdp() {
+    uint8_t datagram[UdpChannel::MAX_DATAGRAM];
+    while (isRunning) {
+        try {
+            Poco::Net::SocketAddress sender;
+            int received = udpSocket.receiveFrom(datagram, sizeof(datagram), sender);
+            uint64_t sessionId = 0;
+            if (received <= 0 || !UdpChannel::peekSessionId(datagram, received, sessionId)) {
+                continue;
+            }
+
+            std::shared_ptr<UdpSession> udp;
+            {
+                std::lock_guard<std::mutex> lock(udpMutex);
+                auto it = udpSessions.find(sessionId);
+                if (it != udpSessions.end()) {
+                    udp = it->second;
                 }
-                catch (Poco::Exception& e) {
-                    logger.error("Error handling client " + clientId + ": " + e.displayText());
-                    clientConnected = false;
+            }
+            UdpChannel::PacketType type;
+            const uint8_t* payload = nullptr;
+            size_t length = 0;
+            // Unknown sessions, forgeries and replays are dropped without an answer.
+            if (!udp || !udp->channel.open(datagram, received, type, payload, length)) {
+                continue;
+            }
+
+            {
+                // The downlink follows the client when its address or NAT mapping changes.
+                std::lock_guard<std::mutex> lock(udp->sendMutex);
+                udp->peer = sender;
+                udp->peerKnown = true;
+                if (type == UdpChannel::UDP_PROBE) {
+                    uint8_t ack[UdpChannel::OVERHEAD];
+                    size_t size = udp->channel.seal(UdpChannel::UDP_PROBE_ACK, nullptr, 0, ack, sizeof(ack));
+                    udpSocket.sendTo(ack, static_cast<int>(size), sender);
                 }
             }
+            if (type == UdpChannel::UDP_DATA) {
+                handleClientData(udp->clientId, udp->clientId + " over UDP", payload, length, udp->session);
+            }
+        }
+        catch (Poco::TimeoutException&) {
+            reloadCertificatesIfChanged();    // Idle: a good moment to look at the files.
+            continue;
         }
         catch (Poco::Exception& e) {
-            logger.error("Fatal error handling client " + clientId + ": " + e.displayText());
+            logger.error("Error on UDP data channel: " + e.displayText());
         }
+    }
+}
 
-        // Remove client from active connections
-        {
-            std::lock_guard<std::mutex> lock(clientsMutex);
-            clients.erase(clientId);
+std::shared_ptr<VPNServer::UdpSession> VPNServer::findUdpSessionLocked(const std::string& clientId) const {
+    for (const auto& udp : udpSessions) {
+        if (udp.second->clientId == clientId) {
+            return udp.second;
         }
+    }
+    return nullptr;
+}
 
-        try {
-            clientSocket.shutdown();
-            clientSocket.close();
-        }
-        catch (...) {
-            // Ignore shutdown errors
+bool VPNServer::sendOverUdp(UdpSession& udp, const uint8_t* data, size_t length) {
+    if (length > UdpChannel::MAX_PAYLOAD) {
+        return false;
+    }
+    uint8_t datagram[UdpChannel::MAX_DATAGRAM];
+    std::lock_guard<std::mutex> lock(udp.sendMutex);
+    if (!udp.peerKnown) {
+        return false;
+    }
+    size_t size = udp.channel.seal(UdpChannel::UDP_DATA, data, length, datagram, sizeof(datagram));
+    if (size == 0) {
+        return false;
+    }
+    try {
+        udpSocket.sendTo(datagram, static_cast<int>(size), udp.peer);
+        return true;
+    }
+    catch (Poco::Exception& e) {
+        logger.warning("UDP send to client " + udp.clientId + " failed, using TCP: " + e.displayText());
+        return false;
+    }
+}
+
+void VPNServer::handleFrame(Client& client, const FrameView& frame) {
+    switch (frame.type) {
+    case FRAME_PING:
+        // Respond to keep-alive
+        sendFrame(*client.connection, FRAME_PONG, nullptr, 0);
+        break;
+    case FRAME_DATA:
+        handleClientData(client.id, client.id, frame.payload, frame.length, client.session);
+        break;
+    default:
+        logger.warning("Unexpected frame type " + std::to_string(frame.type) + " from client " + client.id);
+        break;
+    }
+}
+
+void VPNServer::handleReceivedData(const std::string& clientId,
+                                   const uint8_t* data,
+                                   size_t length,
+                                   const EncryptionSession* session) {
+    if (session) {
+        std::vector<uint8_t> payload = session->decrypt(std::vector<uint8_t>(data, data + length));
+        logger.information("Received " + std::to_string(payload.size()) +
+                         " bytes (" + std::to_string(length) + " encrypted) from client " + clientId);
+        return;
+    }
+    logger.information("Received " + std::to_string(length) +
+                     " bytes from client " + clientId);
+}
+
+void VPNServer::handleClientData(const std::string& clientId,
+                                 const std::string& label,
+                                 const uint8_t* data,
+                                 size_t length,
+                                 const std::shared_ptr<EncryptionSession>& session) {
+    if (packets.empty()) {
+        handleReceivedData(label, data, length, session.get());
+        return;
+    }
+    if (!session) {
+        deliverPacket(clientId, data, length, session);
+        return;
+    }
+    try {
+        std::vector<uint8_t> packet = session->decrypt(std::vector<uint8_t>(data, data + length));
+        deliverPacket(clientId, packet.data(), packet.size(), session);
+    }
+    catch (const std::exception& e) {
+        logger.warning("Dropped undecryptable packet from client " + label + ": " + e.what());
+    }
+}
+
+void VPNServer::deliverPacket(const std::string& clientId, const uint8_t* packet, size_t length,
+                              const std::shared_ptr<EncryptionSession>& session) {
+    std::string source;
+    if (!IpPacket::sourceAddress(packet, length, source)) {
+        return;    // Not IP.
+    }
+    if (ownsAddress(clientId, source, session)) {
+        packets.write(packet, length);    // Into the queue of its flow.
+    }
+}
+
+bool VPNServer::ownsAddress(const std::string& clientId, const std::string& address,
+                            const std::shared_ptr<EncryptionSession>& session) {
+    {
+        std::shared_lock<std::shared_mutex> lock(routesMutex);
+        auto route = routes.find(address);
+        if (route != routes.end()) {
+            return route->second.clientId == clientId;
         }
+    }
+    std::unique_lock<std::shared_mutex> lock(routesMutex);
+    auto route = routes.find(address);    // Another worker may have claimed it meanwhile.
+    if (route != routes.end()) {
+        return route->second.clientId == clientId;
+    }
+    Route learned;
+    learned.clientId = clientId;
+    learned.session = session;
+    {
+        std::lock_guard<std::mutex> clientsLock(clientsMutex);
+        auto client = clients.find(clientId);
+        if (client == clients.end()) return false;    // Already gone.
+        learned.connection = client->second->connection;
+    }
+    {
+        std::lock_guard<std::mutex> udpLock(udpMutex);
+        learned.udp = findUdpSessionLocked(clientId);
+    }
+    routes[address] = learned;
+    logger.information("Client " + clientId + " uses address " + IpPacket::toString(address));
+    return true;
+}
 
-        logger.information("Client disconnected and cleaned up: " + clientId);
+void VPNServer::handlePackets(size_t queue) {
+    if (packets.size() > 1) {
+        PacketQueues::pinToCore(queue);
     }
-    // Processes received data from a client.
-    void handleReceivedData(const std::string& clientId, 
-                           const std::vector<uint8_t>& buffer, 
-                           int received) {
-        // Check if it's a keep-alive ping (0x01)
-        if (received == 1 && buffer[0] == 0x01) {
-            // Respond to keep-alive
-            std::vector<uint8_t> pong = {0x02};
-            try {
-                std::lock_guard<std::mutex> lock(clientsMutex);
-                if (clients.find(clientId) != clients.end()) {
-                    clients[clientId].sendBytes(pong.data(), pong.size());
-                }
-            }
-            catch (Poco::Exception& e) {
-                logger.error("Error sending keep-alive response to " + 
-                           clientId + ": " + e.displayText());
+    PacketSource& source = packets.queue(queue);
+    PacketBatch batch;
+    std::string destination;
+    while (isRunning) {
+        batch.clear();
+        if (source.readBatch(batch, 1000) < 0) {
+            break;    // Source closed.
+        }
+        std::shared_lock<std::shared_mutex> lock(routesMutex);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!IpPacket::destinationAddress(batch.data(i), batch.length(i), destination)) continue;
+            auto route = routes.find(destination);
+            if (route == routes.end()) continue;
+            const uint8_t* data = batch.data(i);
+            size_t length = batch.length(i);
+            std::vector<uint8_t> sealed;
+            if (route->second.session) {
+                sealed = route->second.session->encrypt(std::vector<uint8_t>(data, data + length));
+                data = sealed.data();
+                length = sealed.size();
             }
-            return;
+            // TCP only when the client has no working UDP channel or the packet does not fit.
+            if (route->second.udp && sendOverUdp(*route->second.udp, data, length)) continue;
+            route->second.connection->sendFrame(FRAME_DATA, 0, data, length);
         }
+    }
+}
+
+bool VPNServer::start() {
+    if (isRunning) return false;
 
-        // Process other data packets
-        logger.information("Received " + std::to_string(received) + 
-                         " bytes from client " + clientId);
+    isRunning = true;
+    logger.information("VPN Server starting...");
+
+    try {
+        if (udpEnabled) {
+            udpReceiver.reset(new RunnableWrapper([this]() { handleUdp(); }));
+            udpThread.start(*udpReceiver);
+            logger.information("UDP data channel listening on port " + std::to_string(port));
+        }
+        for (size_t queue = 0; queue < packets.size(); ++queue) {
+            packetWorkers.emplace_back(&VPNServer::handlePackets, this, queue);
+        }
+    }
+    catch (const std::exception& e) {    // Poco::SystemException or std::system_error.
+        logger.error(std::string("VPN Server failed to start: ") + e.what());
+        stop();
+        return false;
+    }
+    if (!packets.empty()) {
+        logger.information("Data plane on " + packets.name());
     }
 
-public:
-    // Constructor to initialize the server.
-    VPNServer(uint16_t port)
-        : threadPool(4, 32)   // Thread pool with a minimum of 4 and a maximum of 32 threads.
-        , isRunning(false)
-        , logger(initLogger()) {
-        
-        // Initialize SSL
-        Poco::Net::initializeSSL();    // Initialize the SSL subsystem.
-        
-        // Create SSL context and server socket
-        Poco::Net::Context::Ptr context = getSSLContext();     // Create SSL context.
-        serverSocket = Poco::Net::SecureServerSocket(
-            Poco::Net::SocketAddress("0.0.0.0", port),  // Bind to all network interfaces on the specified port.
-            64,     // Connection backlog.
-            context    // SSL context for secure connections.
-        );
-
-        serverSocket.setReceiveTimeout(Poco::Timespan(5, 0)); // Set a 5-second timeout for receiving data.
-        logger.information("VPN Server initialized on port " + std::to_string(port));
-    }
-
-    ~VPNServer() {
-        stop();    // Stop the server and clean up resources.
-        Poco::Net::uninitializeSSL();    // Uninitialize the SSL subsystem.
-    }
-    // Starts the server to accept client connections.
-    void start() {
-        if (isRunning) return;
-
-        isRunning = true;
-        logger.information("VPN Server starting...");
-
-        while (isRunning) {
+    // The first loop accepts: one multishot accept on io_uring, readiness on epoll.
+    EventLoop& acceptor = *eventLoops.front();
+    acceptor.post([this, &acceptor]() {
+        acceptor.listen(serverSocket, [this](const Poco::Net::StreamSocket& socket) {
             try {
-                Poco::Net::SecureStreamSocket clientSocket = serverSocket.acceptConnection();
-
-                // Handle client in thread pool using RunnableWrapper
-                std::shared_ptr<RunnableWrapper> runnable = std::make_shared<RunnableWrapper>([this, clientSocket]() mutable {
-                    handleClient(clientSocket);
-                });
-                threadPool.start(*runnable);
-            }
-            catch (Poco::TimeoutException&) {
-                continue;
+                handleClient(secureConnection(socket));
             }
             catch (Poco::Exception& e) {
                 logger.error("Error accepting connection: " + e.displayText());
-                Poco::Thread::sleep(1000); // Wait before retry
             }
-        }
+        });
+    });
+    return true;
+}
+
+void VPNServer::waitForStop() {
+    // Until stop(), this thread only looks after the certificate files.
+    std::unique_lock<std::mutex> lock(stopMutex);
+    while (isRunning) {
+        stopRequested.wait_for(lock, std::chrono::seconds(5));
+        if (isRunning) reloadCertificatesIfChanged();
     }
-// Stops the server and cleans up resources.
-    void stop() {
-        if (!isRunning) return;
+}
 
-        logger.information("VPN Server stopping...");
+void VPNServer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        if (!isRunning) return;
         isRunning = false;
+    }
+    logger.information("VPN Server stopping...");
+    stopRequested.notify_all();
 
-        // Close all client connections
+    // Close all client connections; the loops finish what is already queued.
+    std::vector<std::shared_ptr<Client>> closing;
+    {
         std::lock_guard<std::mutex> lock(clientsMutex);
         for (auto& client : clients) {
-            try {
-                client.second.shutdown();
-                client.second.close();
-            }
-            catch (...) {
-                // Ignore shutdown errors
-            }
-        }
-        clients.clear();
-
-        // Close server socket
-        try {
-            serverSocket.close();
+            closing.push_back(client.second);
         }
-        catch (...) {
-            // Ignore close errors
-        }
-
-        // Wait for all threads to complete
-        threadPool.joinAll();
-        logger.information("VPN Server stopped");
+    }
+    for (auto& client : closing) {
+        client->connection->close();
     }
 
-    bool isActive() const {
-        return isRunning;
+    // Wait for all threads to complete
+    for (auto& loop : eventLoops) {
+        loop->stop();
     }
 
-    size_t getConnectedClientsCount() const {
+    // Close server socket
+    try {
+        serverSocket.close();
+    }
+    catch (...) {
+        // Ignore close errors
+    }
+    if (!packetWorkers.empty()) {
+        packets.close();
+        for (std::thread& worker : packetWorkers) {
+            worker.join();
+        }
+        packetWorkers.clear();
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(routesMutex);
+        routes.clear();
+    }
+    for (auto& client : closing) {
+        client->connection.reset();    // Its handlers hold the client; let both go.
+    }
+    {
         std::lock_guard<std::mutex> lock(clientsMutex);
-        return clients.size();
+        clients.clear();
     }
-};
+    if (udpReceiver) {
+        udpThread.join();    // Returns within the 1-second receive timeout.
+        udpReceiver.reset();
+    }
+    {
+        std::lock_guard<std::mutex> udpLock(udpMutex);
+        udpSessions.clear();
+    }
+    logger.information("VPN Server stopped");
+}
+
+void VPNServer::setPacketSource(std::shared_ptr<PacketSource> source) {
+    packets = PacketQueues({std::move(source)});
+}
+
+void VPNServer::setPacketQueues(PacketQueues queues) {
+    packets = std::move(queues);
+}
+
+size_t VPNServer::getConnectedClientsCount() const {
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    return clients.size();
+}
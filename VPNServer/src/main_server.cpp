@@ -1,15 +1,52 @@
 #include "VPNServer.h"
+#include "CipherSelector.h"
+#include "TunDevice.h"
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
 #include <iostream>
 
+namespace {
+
+// Opens the queues of TUN interface `name`: VPN_TUN_QUEUES of them, one per core by
+// default, or a single queue when the device is not multi-queue.
+PacketQueues openTunQueues(const char* name) {
+    const char* configured = std::getenv("VPN_TUN_QUEUES");
+    unsigned queues = configured ? static_cast<unsigned>(std::atoi(configured)) : std::thread::hardware_concurrency();
+    try {
+        return TunDevice::openQueues(name, queues);
+    }
+    catch (const std::runtime_error& e) {
+        if (queues <= 1) throw;
+        std::cerr << e.what() << ", using one queue" << std::endl;
+        return TunDevice::openQueues(name, 1);
+    }
+}
+
+}
+
 int main() {
     try {
+        std::cout << "Cipher selection: " << CipherSelector::instance().describe() << std::endl;
+
         VPNServer server(8443);
+        // VPN_TUN names a TUN interface that carries the clients' IP packets; without it
+        // their data is only logged.
+        if (const char* tun = std::getenv("VPN_TUN")) {
+            PacketQueues queues = openTunQueues(tun);
+            std::cout << "Data plane: TUN device " << queues.name() << std::endl;
+            server.setPacketQueues(queues);
+        }
         
         std::cout << "Starting VPN Server on port 8443..." << std::endl;
         if (server.start()) {
             std::cout << "Server started successfully. Press Enter to stop." << std::endl;
-            std::cin.get();
-            server.stop();
+            std::thread console([&server]() {
+                std::cin.get();
+                server.stop();
+            });
+            server.waitForStop();    // Reloads renewed certificates meanwhile.
+            console.join();
         }
         else {
             std::cout << "Failed to start server." << std::endl;